@@ -0,0 +1,157 @@
+/*
+ *	Parser and command throughput of the ld2410 library, measured on a PC so regressions show up before anything is flashed.
+ *
+ *	pio run -e native -t exec, or build this directory with -Inative -I../lib/ld2410 -I../src, the library sources and ../src/telemetry.cpp. An argument scales the work, 1 by default.
+ *
+ *	Every fixture is replayed through read() until BENCHMARK_PARSER_BYTES have been parsed, then batches of gate sensitivity commands are queued and answered, then engineering frames are sent as batched telemetry records, full and delta encoded. It exits 1 if the parser misses a frame or a command fails, so it can be run as a build check.
+ *
+ */
+#include <Arduino.h>
+#include <ld2410.h>
+#include <stdlib.h>
+#include "fixtures.h"
+#include "mock_stream.h"
+#include "telemetry.h"
+
+#define BENCHMARK_PARSER_BYTES 4000000UL								//Bytes parsed per fixture
+#define BENCHMARK_COMMAND_BATCHES 20000UL								//Configuration batches, each of nine gate commands plus entering and leaving configuration mode
+#define BENCHMARK_TELEMETRY_FRAMES 1000000UL							//Reports encoded per telemetry mode
+
+class benchmark_sink_ : public Print	{								//Counts what it is given, like a USB CDC that never stalls
+
+	public:
+		size_t write(uint8_t) override
+		{
+			bytes++;
+			return 1;
+		}
+		size_t write(const uint8_t *, size_t size) override
+		{
+			bytes += size;
+			writes++;
+			return size;
+		}
+		uint64_t bytes = 0;
+		uint64_t writes = 0;
+};
+
+static uint64_t now_ns_()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool benchmark_parser_(const benchmark_fixture &fixture, uint32_t scale)
+{
+	ld2410 radar_;
+	mock_stream stream_;
+	radar_.begin(stream_, false);
+	uint32_t passes_ = (BENCHMARK_PARSER_BYTES * scale) / fixture.length;
+	stream_.replay(fixture.bytes, fixture.length, passes_);
+	uint64_t frames_ = 0;
+	uint64_t start_ = now_ns_();
+	while(stream_.replaying())
+	{
+		frames_ += radar_.read();
+	}
+	uint64_t elapsed_ = now_ns_() - start_;
+	uint64_t bytes_ = (uint64_t)passes_ * fixture.length;
+	uint64_t expected_ = (uint64_t)passes_ * fixture.frames;
+	printf("parser %-12s %10llu bytes %9llu frames %8.2f ns/byte %12.0f frames/s%s\n", fixture.name,
+		(unsigned long long)bytes_, (unsigned long long)frames_, (double)elapsed_ / bytes_, frames_ * 1e9 / elapsed_,
+		frames_ == expected_ ? "" : "  MISSED FRAMES");
+	return frames_ == expected_;
+}
+
+static bool benchmark_commands_(uint32_t scale)
+{
+	ld2410 radar_;
+	mock_stream stream_;
+	radar_.begin(stream_, false);
+	uint32_t batches_ = BENCHMARK_COMMAND_BATCHES * scale;
+	uint64_t commands_ = 0;
+	uint64_t encode_ns_ = 0;
+	uint32_t failures_ = 0;
+	uint64_t start_ = now_ns_();
+	for(uint32_t batch_ = 0; batch_ < batches_; batch_++)
+	{
+		if(radar_.beginConfiguration() == false)
+		{
+			failures_++;
+			continue;
+		}
+		uint64_t encode_start_ = now_ns_();
+		for(uint8_t gate_ = 0; gate_ < 9; gate_++)
+		{
+			if(radar_.setGateSensitivityThresholdAsync(gate_, 20 + gate_ + (batch_ & 0x0F), 15 + gate_) == 0)
+			{
+				failures_++;
+			}
+		}
+		encode_ns_ += now_ns_() - encode_start_;
+		commands_ += 9;
+		if(radar_.commitConfiguration() == false)						//Drains the queue, each command answered as soon as it is written
+		{
+			failures_++;
+		}
+	}
+	uint64_t elapsed_ = now_ns_() - start_;
+	uint64_t round_trips_ = stream_.commandsAnswered();
+	printf("commands encode     %10llu commands %8.2f ns/command\n", (unsigned long long)commands_, (double)encode_ns_ / commands_);
+	printf("commands round trip %10llu commands %8.2f ns/command %12.0f commands/s%s\n", (unsigned long long)round_trips_,
+		(double)elapsed_ / round_trips_, round_trips_ * 1e9 / elapsed_, failures_ == 0 ? "" : "  FAILED");
+	return failures_ == 0;
+}
+
+static void benchmark_telemetry_(bool delta, uint32_t scale)
+{
+	benchmark_sink_ sink_;
+	TelemetryBatch batch_(sink_);
+	TelemetryDeltaEncoder encoder_;
+	ld2410_report report_ = {};
+	report_.engineering = true;
+	report_.target_type = 0x03;
+	uint32_t frames_ = BENCHMARK_TELEMETRY_FRAMES * scale;
+	uint64_t start_ = now_ns_();
+	for(uint32_t frame_ = 0; frame_ < frames_; frame_++)
+	{
+		report_.sequence = frame_ + 1;
+		report_.timestamp_us = (uint64_t)frame_ * 50000;				//20 frames a second
+		report_.moving_target_distance = 100 + (frame_ & 0x3F);
+		report_.stationary_target_distance = 150;
+		for(uint8_t gate_ = 0; gate_ < 9; gate_++)
+		{
+			report_.moving_energy[gate_] = 30 + gate_ + ((frame_ + gate_) % 7);	//Some gates move past the dead-band, some don't
+			report_.stationary_energy[gate_] = 20 + gate_;
+		}
+		if(delta == true)
+		{
+			encoder_.send(batch_, report_);
+		}
+		else
+		{
+			sendTelemetryReport(batch_, report_);
+		}
+	}
+	batch_.flush();
+	uint64_t elapsed_ = now_ns_() - start_;
+	printf("telemetry %-9s %10lu frames %8.2f ns/frame %8.2f bytes/frame %8.2f frames/write\n", delta ? "delta" : "full",
+		(unsigned long)frames_, (double)elapsed_ / frames_, (double)sink_.bytes / frames_, (double)frames_ / sink_.writes);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t scale_ = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+	if(scale_ == 0)
+	{
+		scale_ = 1;
+	}
+	bool passed_ = true;
+	for(const benchmark_fixture &fixture_ : fixtures_)
+	{
+		passed_ = benchmark_parser_(fixture_, scale_) && passed_;
+	}
+	passed_ = benchmark_commands_(scale_) && passed_;
+	benchmark_telemetry_(false, scale_);
+	benchmark_telemetry_(true, scale_);
+	return passed_ ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/*
+ *	Byte streams as the radar sends them, replayed by the native benchmark. Build them with the frame layouts in ld2410.h.
+ *
+ *	Each fixture records how many frames the parser must complete from one pass through it, so a change that loses frames fails the run as well as one that slows it down.
+ *
+ */
+#ifndef fixtures_h
+#define fixtures_h
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint8_t fixture_basic_[] = {				//Basic data frames, one for each target state
+	0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x01,
+	0x62, 0x00, 0x36, 0x00, 0x00, 0x00, 0x62, 0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3,
+	0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x02, 0x00, 0x00, 0x00, 0x8F, 0x00, 0x47, 0x8F, 0x00, 0x55,
+	0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x03, 0x70, 0x00,
+	0x26, 0xC9, 0x00, 0x3E, 0xC9, 0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5
+};
+
+static const uint8_t fixture_engineering_[] = {				//Engineering frames with gate energies, light level and OUT pin
+	0xF4, 0xF3, 0xF2, 0xF1, 0x23, 0x00, 0x01, 0xAA, 0x03, 0x75, 0x00, 0x2D, 0xCD, 0x00, 0x3F, 0xCD,
+	0x00, 0x08, 0x08, 0x3E, 0x29, 0x11, 0x0C, 0x09, 0x06, 0x04, 0x03, 0x02, 0x00, 0x00, 0x3F, 0x30,
+	0x16, 0x0F, 0x0B, 0x09, 0x07, 0x57, 0x01, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2,
+	0xF1, 0x23, 0x00, 0x01, 0xAA, 0x02, 0x00, 0x00, 0x00, 0xD2, 0x00, 0x3A, 0xD2, 0x00, 0x08, 0x08,
+	0x0C, 0x09, 0x06, 0x04, 0x03, 0x03, 0x02, 0x02, 0x01, 0x00, 0x00, 0x3A, 0x2C, 0x14, 0x0E, 0x0A,
+	0x08, 0x06, 0x58, 0x01, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0x23, 0x00,
+	0x01, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0x03, 0x02, 0x02,
+	0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x04, 0x03, 0x02, 0x02, 0x01, 0x01, 0x5A,
+	0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5
+};
+
+static const uint8_t fixture_acks_[] = {				//ACKs for enter configuration, read firmware, read configuration, leave configuration
+	0xFD, 0xFC, 0xFB, 0xFA, 0x08, 0x00, 0xFF, 0x01, 0x00, 0x00, 0x01, 0x00, 0x40, 0x00, 0x04, 0x03,
+	0x02, 0x01, 0xFD, 0xFC, 0xFB, 0xFA, 0x0C, 0x00, 0xA0, 0x01, 0x00, 0x00, 0x00, 0x01, 0x02, 0x01,
+	0x16, 0x24, 0x06, 0x22, 0x04, 0x03, 0x02, 0x01, 0xFD, 0xFC, 0xFB, 0xFA, 0x1C, 0x00, 0x61, 0x01,
+	0x00, 0x00, 0xAA, 0x08, 0x08, 0x08, 0x32, 0x32, 0x28, 0x1E, 0x14, 0x0F, 0x0F, 0x0F, 0x0F, 0x00,
+	0x00, 0x28, 0x28, 0x1E, 0x1E, 0x14, 0x14, 0x14, 0x05, 0x00, 0x04, 0x03, 0x02, 0x01, 0xFD, 0xFC,
+	0xFB, 0xFA, 0x04, 0x00, 0xFE, 0x01, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01
+};
+
+static const uint8_t fixture_corrupted_[] = {				//Good frames behind noise, truncation, a corrupt length, a damaged footer and cut short headers
+	0x00, 0x13, 0xF4, 0xF4, 0x7E, 0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x01, 0x62, 0x00,
+	0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x01, 0x62, 0x00, 0x36, 0x00, 0x00, 0x00, 0x62,
+	0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0xFF, 0x7F, 0x01, 0xAA, 0x03,
+	0x75, 0x00, 0x2D, 0xCD, 0x00, 0x3F, 0xCD, 0x00, 0x08, 0x08, 0x3E, 0xF4, 0xF3, 0xF2, 0xF1, 0x0D,
+	0x00, 0x02, 0xAA, 0x01, 0x62, 0x00, 0x36, 0x00, 0x00, 0x00, 0x62, 0x00, 0x55, 0x00, 0xF8, 0xF7,
+	0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF1, 0x23, 0x00, 0x01, 0xAA, 0x03, 0x75, 0x00, 0x2D, 0xCD, 0x00,
+	0x3F, 0xCD, 0x00, 0x08, 0x08, 0x3E, 0x29, 0x11, 0x0C, 0x09, 0x06, 0x04, 0x03, 0x02, 0x00, 0x00,
+	0x3F, 0x30, 0x16, 0x0F, 0x0B, 0x09, 0x07, 0x57, 0x01, 0x55, 0x00, 0xF8, 0x00, 0xF6, 0xF5, 0xF4,
+	0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02, 0xAA, 0x01, 0x62, 0x00, 0x36, 0x00, 0x00, 0x00, 0x62, 0x00,
+	0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xF4, 0xF3, 0xF2, 0xF4, 0xF3, 0xF2, 0xF1, 0x23, 0x00, 0x01,
+	0xAA, 0x03, 0x75, 0x00, 0x2D, 0xCD, 0x00, 0x3F, 0xCD, 0x00, 0x08, 0x08, 0x3E, 0x29, 0x11, 0x0C,
+	0x09, 0x06, 0x04, 0x03, 0x02, 0x00, 0x00, 0x3F, 0x30, 0x16, 0x0F, 0x0B, 0x09, 0x07, 0x57, 0x01,
+	0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5, 0xFD, 0xFC, 0x55, 0xF4, 0xF3, 0xF2, 0xF1, 0x0D, 0x00, 0x02,
+	0xAA, 0x01, 0x62, 0x00, 0x36, 0x00, 0x00, 0x00, 0x62, 0x00, 0x55, 0x00, 0xF8, 0xF7, 0xF6, 0xF5
+};
+
+struct benchmark_fixture	{
+	const char *name;
+	const uint8_t *bytes;
+	size_t length;
+	uint8_t frames;														//Frames one pass must parse, data and ACK
+};
+
+static const benchmark_fixture fixtures_[] = {
+	{"basic", fixture_basic_, sizeof(fixture_basic_), 4},
+	{"engineering", fixture_engineering_, sizeof(fixture_engineering_), 3},
+	{"acks", fixture_acks_, sizeof(fixture_acks_), 4},
+	{"corrupted", fixture_corrupted_, sizeof(fixture_corrupted_), 5},
+};
+#endif
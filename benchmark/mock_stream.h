@@ -0,0 +1,147 @@
+/*
+ *	A Stream standing in for the radar's UART in the native benchmark.
+ *
+ *	It replays a fixture a number of times, handing over no more than a UART FIFO's worth per available() like the real port. Command frames written to it are answered at once with a successful ACK, so command round trips cost only the library's own time.
+ *
+ */
+#ifndef mock_stream_h
+#define mock_stream_h
+#include <Arduino.h>
+
+#define MOCK_STREAM_FIFO_SIZE 128										//Bytes available() reports at most, the ESP32 UART hardware FIFO
+#define MOCK_STREAM_ACK_BUFFER_SIZE 64
+
+class mock_stream : public Stream	{
+
+	public:
+		void replay(const uint8_t *bytes, size_t length, uint32_t passes)	//Start sending a fixture, passes times back to back
+		{
+			bytes_ = bytes;
+			length_ = length;
+			passes_ = passes;
+			position_ = 0;
+		}
+		bool replaying()
+		{
+			return passes_ > 0 || ack_length_ > ack_position_;
+		}
+		uint32_t commandsAnswered()
+		{
+			return commands_answered_;
+		}
+		int available() override
+		{
+			if(ack_length_ > ack_position_)
+			{
+				return ack_length_ - ack_position_;
+			}
+			if(passes_ == 0)
+			{
+				return 0;
+			}
+			size_t left_ = length_ - position_;
+			return left_ < MOCK_STREAM_FIFO_SIZE ? left_ : MOCK_STREAM_FIFO_SIZE;
+		}
+		int read() override
+		{
+			uint8_t byte_;
+			return readBytes(&byte_, 1) == 1 ? byte_ : -1;
+		}
+		int peek() override
+		{
+			if(ack_length_ > ack_position_)
+			{
+				return ack_[ack_position_];
+			}
+			return passes_ > 0 ? bytes_[position_] : -1;
+		}
+		size_t readBytes(uint8_t *buffer, size_t length) override
+		{
+			if(ack_length_ > ack_position_)
+			{
+				size_t count_ = ack_length_ - ack_position_ < length ? ack_length_ - ack_position_ : length;
+				memcpy(buffer, ack_ + ack_position_, count_);
+				ack_position_ += count_;
+				return count_;
+			}
+			size_t count_ = 0;
+			while(count_ < length && passes_ > 0)
+			{
+				size_t chunk_ = length_ - position_ < length - count_ ? length_ - position_ : length - count_;
+				memcpy(buffer + count_, bytes_ + position_, chunk_);
+				count_ += chunk_;
+				position_ += chunk_;
+				if(position_ == length_)
+				{
+					position_ = 0;
+					passes_--;
+				}
+			}
+			return count_;
+		}
+		size_t write(uint8_t byte) override
+		{
+			return write(&byte, 1);
+		}
+		size_t write(const uint8_t *buffer, size_t size) override			//The library sends each command frame in one write
+		{
+			if(size >= 10 && buffer[0] == 0xFD && size == (size_t)(buffer[4] + (buffer[5] << 8) + 10))
+			{
+				answer_(buffer[6]);
+			}
+			return size;
+		}
+		using Print::write;
+	private:
+		const uint8_t *bytes_ = nullptr;
+		size_t length_ = 0;
+		size_t position_ = 0;
+		uint32_t passes_ = 0;
+		uint8_t ack_[MOCK_STREAM_ACK_BUFFER_SIZE];						//Answer to the last command, read before any more of the fixture
+		size_t ack_length_ = 0;
+		size_t ack_position_ = 0;
+		uint32_t commands_answered_ = 0;
+
+		void answer_(uint8_t command)
+		{
+			static const uint8_t configuration_mode_[] = {0x01, 0x00, 0x40, 0x00};	//Protocol version and buffer size
+			static const uint8_t firmware_[] = {0x00, 0x01, 0x02, 0x01, 0x16, 0x24, 0x06, 0x22};
+			static const uint8_t configuration_[] = {0xAA, 8, 8, 8, 50, 50, 40, 30, 20, 15, 15, 15, 15, 0, 0, 40, 40, 30, 30, 20, 20, 20, 5, 0};
+			const uint8_t *value_ = nullptr;
+			uint8_t value_length_ = 0;
+			if(command == 0xFF)
+			{
+				value_ = configuration_mode_;
+				value_length_ = sizeof(configuration_mode_);
+			}
+			else if(command == 0xA0)
+			{
+				value_ = firmware_;
+				value_length_ = sizeof(firmware_);
+			}
+			else if(command == 0x61)
+			{
+				value_ = configuration_;
+				value_length_ = sizeof(configuration_);
+			}
+			uint8_t data_length_ = 4 + value_length_;
+			static const uint8_t header_[] = {0xFD, 0xFC, 0xFB, 0xFA};
+			static const uint8_t tail_[] = {0x04, 0x03, 0x02, 0x01};
+			memcpy(ack_, header_, 4);
+			ack_[4] = data_length_;
+			ack_[5] = 0;
+			ack_[6] = command;
+			ack_[7] = 0x01;
+			ack_[8] = 0x00;												//Success
+			ack_[9] = 0x00;
+			if(value_length_ > 0)
+			{
+				memcpy(ack_ + 10, value_, value_length_);
+			}
+			memcpy(ack_ + 6 + data_length_, tail_, 4);
+			ack_length_ = 10 + data_length_;
+			ack_position_ = 0;
+			commands_answered_++;
+		}
+};
+#endif
@@ -0,0 +1,126 @@
+/*
+ *	Just enough of the Arduino core to build the ld2410 library on a PC, for the native benchmark environment.
+ *
+ *	Timing comes from the host's steady clock. Print and Stream keep the Arduino signatures the library uses, nothing more.
+ *
+ */
+#ifndef native_arduino_h
+#define native_arduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+typedef uint8_t byte;
+#define F(string_literal) (string_literal)
+#define DEC 10
+#define HEX 16
+
+inline std::chrono::steady_clock::time_point native_start_time_()
+{
+	static const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+	return start_;
+}
+
+inline unsigned long millis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - native_start_time_()).count();
+}
+
+inline unsigned long micros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - native_start_time_()).count();
+}
+
+inline void delay(unsigned long ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class Print	{
+
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t) = 0;
+		virtual void flush() {}
+		virtual size_t write(const uint8_t *buffer, size_t size)
+		{
+			size_t written_ = 0;
+			while(size-- > 0)
+			{
+				written_ += write(*buffer++);
+			}
+			return written_;
+		}
+		size_t write(const char *string)
+		{
+			return write((const uint8_t *)string, strlen(string));
+		}
+		size_t print(const char *string)
+		{
+			return write(string);
+		}
+		size_t print(char character)
+		{
+			return write((uint8_t)character);
+		}
+		size_t print(unsigned long number, int base = DEC)
+		{
+			char digits_[24];
+			snprintf(digits_, sizeof(digits_), base == HEX ? "%lX" : "%lu", number);
+			return write(digits_);
+		}
+		size_t print(long number, int base = DEC)
+		{
+			if(base == HEX)
+			{
+				return print((unsigned long)number, base);
+			}
+			char digits_[24];
+			snprintf(digits_, sizeof(digits_), "%ld", number);
+			return write(digits_);
+		}
+		size_t print(unsigned int number, int base = DEC)	{ return print((unsigned long)number, base); }
+		size_t print(int number, int base = DEC)			{ return print((long)number, base); }
+		size_t print(unsigned char number, int base = DEC)	{ return print((unsigned long)number, base); }
+		size_t print(unsigned long long number, int base = DEC)	{ return print((unsigned long)number, base); }
+		size_t print(double number, int digits = 2)
+		{
+			char digits_[32];
+			snprintf(digits_, sizeof(digits_), "%.*f", digits, number);
+			return write(digits_);
+		}
+		size_t println()
+		{
+			return write("\r\n");
+		}
+		template<typename T> size_t println(T value)
+		{
+			size_t written_ = print(value);
+			return written_ + println();
+		}
+};
+
+class Stream : public Print	{
+
+	public:
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+		virtual size_t readBytes(uint8_t *buffer, size_t length)
+		{
+			size_t count_ = 0;
+			while(count_ < length && available() > 0)
+			{
+				buffer[count_++] = (uint8_t)read();
+			}
+			return count_;
+		}
+		size_t readBytes(char *buffer, size_t length)
+		{
+			return readBytes((uint8_t *)buffer, length);
+		}
+};
+#endif
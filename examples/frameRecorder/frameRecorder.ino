@@ -0,0 +1,209 @@
+/*
+ * Example sketch for ld2410_recorder, keeping the radar's raw frames in LittleFS so false detections can be looked at later without USB, ESP32 only.
+ * 
+ * Recording starts at boot in engineering mode, so the file has the gate energies. Frames are staged in RAM and written a 4KB block at a time
+ * from loop(), the file stops growing at RECORDING_CAPACITY. When a monitor is connected, send:
+ * s - stop recording and flush what is staged
+ * r - start recording again, appending to the file
+ * p - stop recording and replay the file through a second ld2410, printing each frame
+ * d - stop recording and delete the file
+ * 
+ * On ESP32, connect the LD2410 to GPIO pins 32&33
+ * On ESP32S2, connect the LD2410 to GPIO pins 8&9
+ * On ESP32C3 and ESP32C6, connect the LD2410 to GPIO pins 4&5
+ * 
+ */
+
+#if defined(ESP32)
+  #ifdef ESP_IDF_VERSION_MAJOR // IDF 4+
+    #if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 32
+      #define RADAR_TX_PIN 33
+    #elif CONFIG_IDF_TARGET_ESP32S2
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 9
+      #define RADAR_TX_PIN 8
+    #elif CONFIG_IDF_TARGET_ESP32C3 || CONFIG_IDF_TARGET_ESP32C6
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 4
+      #define RADAR_TX_PIN 5
+    #else 
+      #error Target CONFIG_IDF_TARGET is not supported
+    #endif
+  #else // ESP32 Before IDF 4.0
+    #define MONITOR_SERIAL Serial
+    #define RADAR_SERIAL Serial1
+    #define RADAR_RX_PIN 32
+    #define RADAR_TX_PIN 33
+  #endif
+#else
+  #error The recorder example needs LittleFS, so ESP32 only
+#endif
+
+#include <LittleFS.h>
+#include <ld2410.h>
+#include <ld2410_recorder.h>
+
+#define RECORDING_PATH "/frames.bin"
+#define RECORDING_CAPACITY (512UL * 1024UL)   //About 40 minutes of engineering frames, capped to the free space
+
+ld2410 radar;
+ld2410 player;                       //Parses replayed frames, so the live radar's state is untouched. Too big for loop()'s stack
+ld2410_recorder recorder;
+
+void startRecording()
+{
+  uint32_t capacity = RECORDING_CAPACITY;
+  uint32_t available = LittleFS.totalBytes() - LittleFS.usedBytes();
+  if(LittleFS.exists(RECORDING_PATH))
+  {
+    File existing = LittleFS.open(RECORDING_PATH, "r");
+    available += existing.size();   //The file's own blocks count towards its capacity
+    existing.close();
+  }
+  if(available < capacity)
+  {
+    capacity = available > LD2410_RECORDER_BLOCK_SIZE ? available - LD2410_RECORDER_BLOCK_SIZE : 0;  //Leave LittleFS a block for its metadata
+  }
+  if(recorder.begin(LittleFS, RECORDING_PATH, capacity))
+  {
+    recorder.attach(radar);
+    MONITOR_SERIAL.print(F("Recording to " RECORDING_PATH ", "));
+    MONITOR_SERIAL.print(recorder.bytesWritten());
+    MONITOR_SERIAL.print(F(" of "));
+    MONITOR_SERIAL.print(capacity);
+    MONITOR_SERIAL.println(F(" bytes used"));
+  }
+  else
+  {
+    MONITOR_SERIAL.println(F("Could not start recording, the file is full or LittleFS failed"));
+  }
+}
+
+void stopRecording()
+{
+  if(recorder.recording())
+  {
+    recorder.detach(radar);
+    recorder.end();
+    MONITOR_SERIAL.print(F("Recording stopped, "));
+    MONITOR_SERIAL.print(recorder.framesRecorded());
+    MONITOR_SERIAL.print(F(" frames recorded, "));
+    MONITOR_SERIAL.print(recorder.framesDropped());
+    MONITOR_SERIAL.println(F(" dropped"));
+  }
+}
+
+void printReplayedFrame(ld2410 &sensor, const ld2410_report &report, void *context)
+{
+  ld2410_replay_stream *replay = (ld2410_replay_stream *)context;
+  (void)sensor;
+  MONITOR_SERIAL.print((uint32_t)(report.timestamp_us / 1000ULL));
+  MONITOR_SERIAL.print(F("ms seq "));
+  MONITOR_SERIAL.print(replay->sequence());
+  MONITOR_SERIAL.print(F(" target "));
+  MONITOR_SERIAL.print(report.target_type);
+  MONITOR_SERIAL.print(F(" moving "));
+  MONITOR_SERIAL.print(report.moving_target_distance);
+  MONITOR_SERIAL.print(F("cm/"));
+  MONITOR_SERIAL.print(report.moving_target_energy);
+  MONITOR_SERIAL.print(F(" stationary "));
+  MONITOR_SERIAL.print(report.stationary_target_distance);
+  MONITOR_SERIAL.print(F("cm/"));
+  MONITOR_SERIAL.print(report.stationary_target_energy);
+  if(report.engineering)
+  {
+    MONITOR_SERIAL.print(F(" gates"));
+    for(uint8_t gate = 0; gate < 9; gate++)
+    {
+      MONITOR_SERIAL.print(' ');
+      MONITOR_SERIAL.print(report.moving_energy[gate]);
+      MONITOR_SERIAL.print('/');
+      MONITOR_SERIAL.print(report.stationary_energy[gate]);
+    }
+  }
+  MONITOR_SERIAL.println();
+}
+
+void replayRecording()
+{
+  stopRecording();
+  File file = LittleFS.open(RECORDING_PATH, "r");
+  if(!file)
+  {
+    MONITOR_SERIAL.println(F("Nothing recorded"));
+    return;
+  }
+  ld2410_replay_stream replay(file);
+  if(replay.begin() == false)
+  {
+    MONITOR_SERIAL.println(F(RECORDING_PATH " is not a recording"));
+    file.close();
+    return;
+  }
+  player.onDataFrame(printReplayedFrame, &replay);
+  replay.attach(player);               //report.timestamp_us is then when the frame was recorded
+  player.begin(replay, false);
+  while(replay.finished() == false)
+  {
+    player.read();
+  }
+  MONITOR_SERIAL.print(F("Replayed "));
+  MONITOR_SERIAL.print(replay.framesReplayed());
+  MONITOR_SERIAL.println(F(" frames"));
+  replay.detach(player);
+  file.close();
+}
+
+void setup(void)
+{
+  MONITOR_SERIAL.begin(115200); //Feedback over Serial Monitor
+  RADAR_SERIAL.begin(256000, SERIAL_8N1, RADAR_RX_PIN, RADAR_TX_PIN); //UART for monitoring the radar
+  delay(500);
+  if(LittleFS.begin(true) == false)
+  {
+    MONITOR_SERIAL.println(F("LittleFS failed to mount"));
+  }
+  MONITOR_SERIAL.print(F("\nLD2410 radar sensor initialising: "));
+  if(radar.begin(RADAR_SERIAL))
+  {
+    MONITOR_SERIAL.println(F("OK"));
+    radar.requestStartEngineeringMode();
+  }
+  else
+  {
+    MONITOR_SERIAL.println(F("not connected"));
+  }
+  startRecording();
+}
+
+void loop()
+{
+  radar.read();
+  recorder.service();   //At most one block write, the frames keep being staged meanwhile
+  if(MONITOR_SERIAL.available())
+  {
+    char command = MONITOR_SERIAL.read();
+    if(command == 's')
+    {
+      stopRecording();
+    }
+    else if(command == 'r' && recorder.recording() == false)
+    {
+      startRecording();
+    }
+    else if(command == 'p')
+    {
+      replayRecording();
+    }
+    else if(command == 'd')
+    {
+      stopRecording();
+      MONITOR_SERIAL.println(LittleFS.remove(RECORDING_PATH) ? F("Recording deleted") : F("Nothing to delete"));
+    }
+  }
+}
@@ -0,0 +1,229 @@
+/*
+ * Benchmark sketch measuring how long a radar frame takes to reach the host over USB, ESP32 only.
+ * 
+ * Each data frame is timestamped with esp_timer_get_time() at three points: when the parser meets its header (the report's timestamp_us),
+ * when parsing completes (the onDataFrame callback) and when loop() has printed it and the monitor serial has flushed. The stages between
+ * those, plus the whole path, are collected into histograms with power of two microsecond buckets.
+ * 
+ * The run goes through the LOAD_LEVELS in turn, PHASE_DURATION each. At every level loop() spins for that many microseconds after reading,
+ * standing in for whatever else a sketch does, then the histograms for the phase are printed on lines starting with '#'.
+ * Build it again with BENCHMARK_OPTIONS set to LD2410_OPTION_RECEIVE_EVENTS, or with LD2410_OPTION_RADAR_TASK added, to compare the modes.
+ * 
+ * On ESP32, connect the LD2410 to GPIO pins 32&33
+ * On ESP32S2, connect the LD2410 to GPIO pins 8&9
+ * On ESP32C3 and ESP32C6, connect the LD2410 to GPIO pins 4&5
+ * 
+ */
+
+#if defined(ESP32)
+  #ifdef ESP_IDF_VERSION_MAJOR // IDF 4+
+    #if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 32
+      #define RADAR_TX_PIN 33
+    #elif CONFIG_IDF_TARGET_ESP32S2
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 9
+      #define RADAR_TX_PIN 8
+    #elif CONFIG_IDF_TARGET_ESP32C3 || CONFIG_IDF_TARGET_ESP32C6
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 4
+      #define RADAR_TX_PIN 5
+    #else 
+      #error Target CONFIG_IDF_TARGET is not supported
+    #endif
+  #else // ESP32 Before IDF 4.0
+    #define MONITOR_SERIAL Serial
+    #define RADAR_SERIAL Serial1
+    #define RADAR_RX_PIN 32
+    #define RADAR_TX_PIN 33
+  #endif
+#else
+  #error This benchmark needs esp_timer_get_time(), so ESP32 only
+#endif
+
+#include <ld2410.h>
+
+#define BENCHMARK_OPTIONS 0             //0 polls the UART from loop(), or LD2410_OPTION_RECEIVE_EVENTS, optionally | LD2410_OPTION_RADAR_TASK
+#define BENCHMARK_ENGINEERING_MODE true //Engineering frames are 45 bytes rather than 23, so take longer on the wire and to parse
+#define PHASE_DURATION 30000            //ms at each load level
+#define HISTOGRAM_BUCKETS 20            //Bucket n counts latencies below 2^n us, the last one everything longer
+
+const uint32_t LOAD_LEVELS[] = {0, 1000, 5000, 20000, 100000};   //us of busy work per loop()
+const uint8_t LOAD_LEVEL_COUNT = sizeof(LOAD_LEVELS) / sizeof(LOAD_LEVELS[0]);
+
+struct LatencyHistogram
+{
+  uint32_t count;
+  uint32_t minimum;
+  uint32_t maximum;
+  uint64_t total;
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+enum Stage { HEADER_TO_PARSED, PARSED_TO_LOOP, LOOP_TO_FLUSHED, HEADER_TO_FLUSHED, STAGE_COUNT };
+const char *STAGE_NAMES[STAGE_COUNT] = {"header>parsed", "parsed>loop", "loop>flushed", "header>flushed"};
+
+ld2410 radar;
+LatencyHistogram histograms[STAGE_COUNT];
+volatile int64_t parsedAt[LD2410_HISTORY_LENGTH];     //Written by onDataFrame, which is in the radar task with LD2410_OPTION_RADAR_TASK
+volatile uint32_t parsedSequence[LD2410_HISTORY_LENGTH];
+uint32_t framesUnmatched = 0;                         //Popped after their parse timestamp had been overwritten
+uint32_t droppedAtStart = 0;
+uint8_t loadLevel = 0;
+uint32_t phaseStarted = 0;
+
+void frameParsed(ld2410 &sensor, const ld2410_report &report, void *context)
+{
+  (void)sensor;
+  (void)context;
+  uint8_t index = report.sequence & (LD2410_HISTORY_LENGTH - 1);  //Same indexing as the library's own history
+  parsedAt[index] = esp_timer_get_time();
+  parsedSequence[index] = report.sequence;
+}
+
+void record(Stage stage, int64_t from, int64_t to)
+{
+  LatencyHistogram &histogram = histograms[stage];
+  uint32_t latency = to > from ? (uint32_t)(to - from) : 0;
+  uint8_t bucket = 0;
+  while(bucket < HISTOGRAM_BUCKETS - 1 && latency >= (1UL << bucket))
+  {
+    bucket++;
+  }
+  histogram.buckets[bucket]++;
+  if(histogram.count == 0 || latency < histogram.minimum)
+  {
+    histogram.minimum = latency;
+  }
+  if(latency > histogram.maximum)
+  {
+    histogram.maximum = latency;
+  }
+  histogram.total += latency;
+  histogram.count++;
+}
+
+void startPhase(uint8_t level)
+{
+  loadLevel = level;
+  memset(histograms, 0, sizeof(histograms));
+  framesUnmatched = 0;
+  droppedAtStart = radar.reportsDropped();
+  phaseStarted = millis();
+}
+
+void printHistograms()
+{
+  MONITOR_SERIAL.print(F("# load "));
+  MONITOR_SERIAL.print(LOAD_LEVELS[loadLevel]);
+  MONITOR_SERIAL.print(F("us/loop, options 0x"));
+  MONITOR_SERIAL.print(BENCHMARK_OPTIONS, HEX);
+  MONITOR_SERIAL.print(F(", history dropped "));
+  MONITOR_SERIAL.print(radar.reportsDropped() - droppedAtStart);
+  MONITOR_SERIAL.print(F(", unmatched "));
+  MONITOR_SERIAL.println(framesUnmatched);
+  for(uint8_t stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    LatencyHistogram &histogram = histograms[stage];
+    MONITOR_SERIAL.print(F("# "));
+    MONITOR_SERIAL.print(STAGE_NAMES[stage]);
+    MONITOR_SERIAL.print(F(" n="));
+    MONITOR_SERIAL.print(histogram.count);
+    if(histogram.count > 0)
+    {
+      MONITOR_SERIAL.print(F(" min="));
+      MONITOR_SERIAL.print(histogram.minimum);
+      MONITOR_SERIAL.print(F(" avg="));
+      MONITOR_SERIAL.print((uint32_t)(histogram.total / histogram.count));
+      MONITOR_SERIAL.print(F(" max="));
+      MONITOR_SERIAL.print(histogram.maximum);
+      MONITOR_SERIAL.print(F("us |"));
+      for(uint8_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+      {
+        if(histogram.buckets[bucket] > 0)
+        {
+          MONITOR_SERIAL.print(bucket < HISTOGRAM_BUCKETS - 1 ? F(" <") : F(" >="));
+          MONITOR_SERIAL.print(1UL << (bucket < HISTOGRAM_BUCKETS - 1 ? bucket : bucket - 1));
+          MONITOR_SERIAL.print(':');
+          MONITOR_SERIAL.print(histogram.buckets[bucket]);
+        }
+      }
+    }
+    MONITOR_SERIAL.println();
+  }
+  MONITOR_SERIAL.flush();
+}
+
+void busyWait(uint32_t microseconds)
+{
+  int64_t until = esp_timer_get_time() + microseconds;
+  while(esp_timer_get_time() < until)
+  {
+    //Spin rather than delay(), so the load holds the CPU like real work would
+  }
+}
+
+void setup(void)
+{
+  MONITOR_SERIAL.begin(115200); //Feedback over Serial Monitor
+  RADAR_SERIAL.begin(256000, SERIAL_8N1, RADAR_RX_PIN, RADAR_TX_PIN); //UART for monitoring the radar
+  delay(500);
+  radar.onDataFrame(frameParsed);
+  MONITOR_SERIAL.print(F("\n# LD2410 latency benchmark, radar "));
+  if(radar.begin(RADAR_SERIAL, true, BENCHMARK_OPTIONS))
+  {
+    MONITOR_SERIAL.println(F("OK"));
+  }
+  else
+  {
+    MONITOR_SERIAL.println(F("not connected"));
+  }
+  if(BENCHMARK_ENGINEERING_MODE)
+  {
+    radar.requestStartEngineeringMode();
+  }
+  startPhase(0);
+}
+
+void loop()
+{
+  radar.read();
+  ld2410_report report;
+  while(radar.popReport(report))
+  {
+    int64_t looped = esp_timer_get_time();
+    uint8_t index = report.sequence & (LD2410_HISTORY_LENGTH - 1);
+    if(parsedSequence[index] != report.sequence)
+    {
+      framesUnmatched++;
+      continue;
+    }
+    int64_t parsed = parsedAt[index];
+    MONITOR_SERIAL.print(report.sequence);     //A short sample line, as a sketch forwarding frames would send
+    MONITOR_SERIAL.print(',');
+    MONITOR_SERIAL.print(report.target_type);
+    MONITOR_SERIAL.print(',');
+    MONITOR_SERIAL.print(report.moving_target_distance);
+    MONITOR_SERIAL.print(',');
+    MONITOR_SERIAL.println(report.stationary_target_distance);
+    MONITOR_SERIAL.flush();
+    int64_t flushed = esp_timer_get_time();
+    record(HEADER_TO_PARSED, report.timestamp_us, parsed);
+    record(PARSED_TO_LOOP, parsed, looped);
+    record(LOOP_TO_FLUSHED, looped, flushed);
+    record(HEADER_TO_FLUSHED, report.timestamp_us, flushed);
+  }
+  if(LOAD_LEVELS[loadLevel] > 0)
+  {
+    busyWait(LOAD_LEVELS[loadLevel]);
+  }
+  if(millis() - phaseStarted >= PHASE_DURATION)
+  {
+    printHistograms();
+    startPhase((loadLevel + 1) % LOAD_LEVEL_COUNT);
+  }
+}
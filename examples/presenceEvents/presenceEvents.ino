@@ -0,0 +1,109 @@
+/*
+ * Example sketch for the LD2410 callback API, output only happens when something changes.
+ * 
+ * Instead of polling presenceDetected() the sketch registers callbacks and read() runs them as frames arrive, so nothing is printed while a room stays empty.
+ * 
+ * On ESP32, connect the LD2410 to GPIO pins 32&33
+ * On ESP32S2, connect the LD2410 to GPIO pins 8&9
+ * On ESP32C3, connect the LD2410 to GPIO pins 4&5
+ * On Arduino Leonardo or other ATmega32u4 board connect the LD2410 to GPIO pins TX & RX hardware serial
+ * 
+ * The serial configuration for other boards will vary and you'll need to assign them yourself
+ * 
+ */
+
+#if defined(ESP32)
+  #ifdef ESP_IDF_VERSION_MAJOR // IDF 4+
+    #if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 32
+      #define RADAR_TX_PIN 33
+    #elif CONFIG_IDF_TARGET_ESP32S2
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 9
+      #define RADAR_TX_PIN 8
+    #elif CONFIG_IDF_TARGET_ESP32C3
+      #define MONITOR_SERIAL Serial
+      #define RADAR_SERIAL Serial1
+      #define RADAR_RX_PIN 4
+      #define RADAR_TX_PIN 5
+    #else 
+      #error Target CONFIG_IDF_TARGET is not supported
+    #endif
+  #else // ESP32 Before IDF 4.0
+    #define MONITOR_SERIAL Serial
+    #define RADAR_SERIAL Serial1
+    #define RADAR_RX_PIN 32
+    #define RADAR_TX_PIN 33
+  #endif
+#elif defined(__AVR_ATmega32U4__)
+  #define MONITOR_SERIAL Serial
+  #define RADAR_SERIAL Serial1
+  #define RADAR_RX_PIN 0
+  #define RADAR_TX_PIN 1
+#endif
+
+#include <ld2410.h>
+
+ld2410 radar;
+
+void presenceChanged(ld2410 &sensor, bool present, void *context)
+{
+  (void)context;
+  if(present)
+  {
+    MONITOR_SERIAL.print(F("Presence detected, nearest target: "));
+    MONITOR_SERIAL.print(sensor.movingTargetDetected() ? sensor.movingTargetDistance() : sensor.stationaryTargetDistance());
+    MONITOR_SERIAL.println(F("cm"));
+  }
+  else
+  {
+    MONITOR_SERIAL.println(F("Presence ended"));
+  }
+}
+
+void ackReceived(ld2410 &sensor, uint8_t command, bool success, void *context)
+{
+  (void)sensor;
+  (void)context;
+  MONITOR_SERIAL.print(F("ACK for command 0x"));
+  MONITOR_SERIAL.print(command, HEX);
+  MONITOR_SERIAL.println(success ? F(" OK") : F(" failed"));
+}
+
+void connectionLost(ld2410 &sensor, void *context)
+{
+  (void)sensor;
+  (void)context;
+  MONITOR_SERIAL.println(F("LD2410 stopped sending data, check connections"));
+}
+
+void setup(void)
+{
+  MONITOR_SERIAL.begin(115200); //Feedback over Serial Monitor
+  #if defined(ESP32)
+    RADAR_SERIAL.begin(256000, SERIAL_8N1, RADAR_RX_PIN, RADAR_TX_PIN); //UART for monitoring the radar
+  #elif defined(__AVR_ATmega32U4__)
+    RADAR_SERIAL.begin(256000); //UART for monitoring the radar
+  #endif
+  delay(500);
+  radar.onPresenceChange(presenceChanged);
+  radar.onAck(ackReceived);
+  radar.onConnectionLost(connectionLost);
+  MONITOR_SERIAL.print(F("\nLD2410 radar sensor initialising: "));
+  if(radar.begin(RADAR_SERIAL))
+  {
+    MONITOR_SERIAL.println(F("OK"));
+  }
+  else
+  {
+    MONITOR_SERIAL.println(F("not connected"));
+  }
+}
+
+void loop()
+{
+  radar.read();   //Runs the callbacks, nothing else to do here
+}
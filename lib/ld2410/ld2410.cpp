@@ -13,7 +13,39 @@
 #ifndef ld2410_cpp
 #define ld2410_cpp
 #include "ld2410.h"
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+
+static constexpr uint8_t ld2410_command_header_[4] = {0xFD, 0xFC, 0xFB, 0xFA};	//Every command frame starts and ends with these
+static constexpr uint8_t ld2410_command_tail_[4] = {0x04, 0x03, 0x02, 0x01};
+static constexpr uint8_t ld2410_data_header_[4] = {0xF4, 0xF3, 0xF2, 0xF1};	//Data frames from the radar
+static constexpr uint8_t ld2410_data_tail_[4] = {0xF8, 0xF7, 0xF6, 0xF5};
+
+static inline uint64_t ld2410_timestamp_us_()
+{
+	#if defined(ESP32)
+	return esp_timer_get_time();		//64 bit, doesn't wrap like micros()
+	#else
+	return micros();
+	#endif
+}
+
+static inline uint32_t ld2410_cycle_count_()
+{
+	#if defined(ESP32)
+	return ESP.getCycleCount();
+	#else
+	return micros();
+	#endif
+}
 
+#ifdef LD2410_TRACE
+#define LD2410_TRACE_EVENT(type, code, value) trace_event_(type, code, value)
+#else
+#define LD2410_TRACE_EVENT(type, code, value)
+#endif
 
 ld2410::ld2410()	//Constructor function
 {
@@ -21,7 +53,256 @@ ld2410::ld2410()	//Constructor function
 
 ld2410::~ld2410()	//Destructor function
 {
+	#if defined(ESP32)
+	if(receive_events_ == true || radar_task_ != nullptr)
+	{
+		radar_hw_uart_->onReceive(NULL);
+	}
+	if(radar_task_ != nullptr)
+	{
+		lock_();						//Don't delete the task part way through a frame
+		vTaskDelete(radar_task_);
+		radar_task_ = nullptr;
+		unlock_();
+		vSemaphoreDelete(radar_mutex_);
+		radar_mutex_ = nullptr;
+	}
+	#endif
+}
+
+#if defined(ESP32)
+bool ld2410::begin(HardwareSerial &radarSerial, bool waitForRadar, uint8_t options)	{
+	radar_hw_uart_ = &radarSerial;
+	if((options & LD2410_OPTION_RECEIVE_EVENTS) && !(options & LD2410_OPTION_RADAR_TASK))	//The radar task reads the UART itself
+	{
+		radar_rx_ring_.clear();
+		receive_events_ = true;
+		radarSerial.onReceive([this]() { receive_event_(); }, false);	//Called on FIFO threshold and on RX timeout at the end of each frame
+	}
+	bool found_ = begin((Stream &)radarSerial, waitForRadar);
+	if(found_ == false && (options & LD2410_OPTION_AUTO_BAUD))	//The radar may have been left at another rate by setBaudRate()
+	{
+		if(detectBaudRate() != 0)
+		{
+			found_ = requestFirmwareVersion();
+		}
+	}
+	if(options & LD2410_OPTION_RADAR_TASK)	//Started once the blocking startup is done, so it has the UART to itself from here
+	{
+		if(start_radar_task_() == false)
+		{
+			return false;
+		}
+	}
+	return found_;
+}
+
+bool ld2410::start_radar_task_()
+{
+	if(radar_task_ != nullptr)
+	{
+		return true;
+	}
+	radar_mutex_ = xSemaphoreCreateRecursiveMutex();
+	if(radar_mutex_ == nullptr)
+	{
+		return false;
+	}
+	task_read_sequence_ = frame_sequence_;
+	if(xTaskCreatePinnedToCore(radar_task_loop_, "ld2410", LD2410_TASK_STACK_SIZE, this, LD2410_TASK_PRIORITY, &radar_task_, LD2410_TASK_CORE) != pdPASS)
+	{
+		radar_task_ = nullptr;
+		vSemaphoreDelete(radar_mutex_);
+		radar_mutex_ = nullptr;
+		return false;
+	}
+	radar_hw_uart_->onReceive([this]() { xTaskNotifyGive(radar_task_); }, false);	//Wake the task on FIFO threshold and at the end of each frame
+	return true;
+}
+
+void ld2410::radar_task_loop_(void *parameter)
+{
+	ld2410 &radar = *(ld2410 *)parameter;
+	for(;;)
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LD2410_TASK_POLL_INTERVAL));	//Woken by the receive callback or a newly queued command
+		radar.lock_();
+		if(radar.radar_task_paused_ == false)
+		{
+			uint8_t frames_parsed_ = radar.read_frame_();
+			radar.process_commands_();	//Command callbacks run here, in the radar task
+			radar.check_connection_(frames_parsed_);
+			radar.process_calibration_();
+			radar.process_adaptive_engineering_();
+		}
+		radar.unlock_();
+	}
+}
+
+void ld2410::pause_radar_task_(bool paused)
+{
+	lock_();			//Waits for the frame being parsed to finish
+	radar_task_paused_ = paused;
+	unlock_();
+}
+
+bool ld2410::radar_task_running_()
+{
+	return radar_task_ != nullptr && radar_task_paused_ == false;
+}
+
+static const uint32_t ld2410_baud_rates_[] = {9600, 19200, 38400, 57600, 115200, 230400, 256000, 460800};	//Index + 1 is the value of the baud rate command
+static const uint32_t ld2410_baud_probe_order_[] = {256000, 115200, 460800, 230400, 57600, 38400, 19200, 9600};	//Factory default first
+
+bool ld2410::setBaudRate(uint32_t baud)
+{
+	pause_radar_task_(true);	//Probing needs the frames and ACKs in this task
+	bool changed_ = set_baud_rate_(baud);
+	pause_radar_task_(false);
+	return changed_;
+}
+
+uint32_t ld2410::detectBaudRate()
+{
+	pause_radar_task_(true);
+	uint32_t baud_ = detect_baud_rate_();
+	pause_radar_task_(false);
+	return baud_;
+}
+
+bool ld2410::set_baud_rate_(uint32_t baud)
+{
+	uint8_t index_ = 0;
+	for(uint8_t i = 0; i < sizeof(ld2410_baud_rates_) / sizeof(ld2410_baud_rates_[0]); i++)
+	{
+		if(ld2410_baud_rates_[i] == baud)
+		{
+			index_ = i + 1;
+		}
+	}
+	if(radar_hw_uart_ == nullptr || index_ == 0 || command_queue_length_ + 3 > LD2410_COMMAND_QUEUE_LENGTH)
+	{
+		return false;
+	}
+	uint32_t previous_baud_ = baudRate();
+	bool changed_ = false;
+	bool restarted_ = false;
+	const uint8_t enter_value_[2] = {0x01, 0x00};
+	const uint8_t baud_value_[2] = {index_, 0x00};
+	submitCommand(0xFF, enter_value_, sizeof(enter_value_));			//Enter configuration mode
+	submitCommand(0xA1, baud_value_, sizeof(baud_value_), blocking_command_callback_, &changed_);
+	submitCommand(0xA3, nullptr, 0, blocking_command_callback_, &restarted_);	//The new rate only applies after a restart, which also leaves configuration mode
+	while(commandsPending() > 0)
+	{
+		read();
+	}
+	if(changed_ == false || restarted_ == false)
+	{
+		bool left_ = false;
+		wait_for_command_(submitCommand(0xFE, nullptr, 0, blocking_command_callback_, &left_), left_);	//Leave configuration mode
+		return false;
+	}
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(F("\nLD2410 restarting at "));
+		debug_uart_->print(baud);
+	}
+	#endif
+	if(probe_baud_rate_(baud, LD2410_RESTART_TIMEOUT))
+	{
+		return true;
+	}
+	if(probe_baud_rate_(previous_baud_, LD2410_RESTART_TIMEOUT))	//The radar didn't take the change, carry on at the old rate
+	{
+		return false;
+	}
+	return detect_baud_rate_() == baud;
+}
+
+uint32_t ld2410::detect_baud_rate_()
+{
+	if(radar_hw_uart_ == nullptr)
+	{
+		return 0;
+	}
+	uint32_t current_baud_ = baudRate();
+	if(probe_baud_rate_(current_baud_, LD2410_BAUD_PROBE_TIME))
+	{
+		return current_baud_;
+	}
+	for(uint8_t i = 0; i < sizeof(ld2410_baud_probe_order_) / sizeof(ld2410_baud_probe_order_[0]); i++)
+	{
+		if(ld2410_baud_probe_order_[i] != current_baud_ && probe_baud_rate_(ld2410_baud_probe_order_[i], LD2410_BAUD_PROBE_TIME))
+		{
+			#ifdef LD2410_DEBUG_COMMANDS
+			if(debug_uart_ != nullptr)
+			{
+				debug_uart_->print(F("\nLD2410 found at "));
+				debug_uart_->print(ld2410_baud_probe_order_[i]);
+			}
+			#endif
+			return ld2410_baud_probe_order_[i];
+		}
+	}
+	radar_hw_uart_->updateBaudRate(current_baud_);
+	return 0;
+}
+
+uint32_t ld2410::baudRate()
+{
+	if(radar_hw_uart_ == nullptr)
+	{
+		return 0;
+	}
+	uint32_t actual_baud_ = radar_hw_uart_->baudRate();	//The UART reports what its divider achieved, which is rarely exact
+	for(uint8_t i = 0; i < sizeof(ld2410_baud_rates_) / sizeof(ld2410_baud_rates_[0]); i++)
+	{
+		uint32_t tolerance_ = ld2410_baud_rates_[i] / 32;
+		if(actual_baud_ + tolerance_ >= ld2410_baud_rates_[i] && actual_baud_ <= ld2410_baud_rates_[i] + tolerance_)
+		{
+			return ld2410_baud_rates_[i];
+		}
+	}
+	return actual_baud_;
+}
+
+bool ld2410::probe_baud_rate_(uint32_t baud, uint32_t timeout)
+{
+	radar_hw_uart_->updateBaudRate(baud);
+	frame_started_ = false;				//Anything half received was at the old rate
+	radar_data_frame_position_ = 0;
+	uint32_t probe_start_ = millis();
+	while(millis() - probe_start_ < timeout)
+	{
+		if(read_frame_() > 0)			//A running radar streams data frames, which is quicker than asking
+		{
+			return true;
+		}
+		if(millis() - probe_start_ >= timeout / 2 && requestFirmwareVersion())	//Engineering or configuration mode may be quiet, so ask as well
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void ld2410::receive_event_()
+{
+	uint8_t block_[LD2410_UART_BUFFER_SIZE];
+	int bytes_available_ = radar_hw_uart_ -> available();
+	while(bytes_available_ > 0)
+	{
+		size_t bytes_read_ = radar_hw_uart_ -> read(block_, bytes_available_ < LD2410_UART_BUFFER_SIZE ? bytes_available_ : LD2410_UART_BUFFER_SIZE);
+		if(bytes_read_ == 0)
+		{
+			break;
+		}
+		counters_.receive_overflow_bytes += bytes_read_ - radar_rx_ring_.write(block_, bytes_read_);	//If read() has fallen this far behind the oldest bytes are kept and the newest dropped
+		bytes_available_ -= bytes_read_;
+	}
 }
+#endif
 
 bool ld2410::begin(Stream &radarStream, bool waitForRadar)	{
 	radar_uart_ = &radarStream;		//Set the stream used for the LD2410
@@ -67,6 +348,26 @@ bool ld2410::begin(Stream &radarStream, bool waitForRadar)	{
 	return false;
 }
 
+void ld2410::lock_()
+{
+	#if defined(ESP32)
+	if(radar_mutex_ != nullptr)
+	{
+		xSemaphoreTakeRecursive(radar_mutex_, portMAX_DELAY);
+	}
+	#endif
+}
+
+void ld2410::unlock_()
+{
+	#if defined(ESP32)
+	if(radar_mutex_ != nullptr)
+	{
+		xSemaphoreGiveRecursive(radar_mutex_);
+	}
+	#endif
+}
+
 void ld2410::debug(Stream &terminalStream)
 {
 	debug_uart_ = &terminalStream;		//Set the stream used for the terminal
@@ -78,12 +379,43 @@ void ld2410::debug(Stream &terminalStream)
 	#endif
 }
 
+#ifdef LD2410_TRACE
+void ld2410::trace_event_(uint8_t type, uint8_t code, uint16_t value)
+{
+	ld2410_trace_event event_;
+	event_.time_us = (uint32_t)ld2410_timestamp_us_();
+	event_.type = type;
+	event_.code = code;
+	event_.value = value;
+	if(trace_.push(event_) == false)
+	{
+		trace_dropped_++;
+	}
+}
+
+bool ld2410::popTrace(ld2410_trace_event &event)
+{
+	return trace_.pop(event);
+}
+
+uint32_t ld2410::traceDropped()
+{
+	return trace_dropped_;
+}
+#endif
+
 bool ld2410::isConnected()
 {
 	if(millis() - radar_uart_last_packet_ < radar_uart_timeout)	//Use the last reading
 	{
 		return true;
 	}
+	#if defined(ESP32)
+	if(radar_task_running_())	//The radar task would have seen a frame if there was one
+	{
+		return false;
+	}
+	#endif
 	if(read_frame_())	//Try and read a frame if the current reading is too old
 	{
 		return true;
@@ -91,19 +423,175 @@ bool ld2410::isConnected()
 	return false;
 }
 
-bool ld2410::read()
+uint8_t ld2410::read()
+{
+	#if defined(ESP32)
+	if(radar_task_running_())	//Parsing happens in the radar task, just report what it has published
+	{
+		uint32_t sequence_ = __atomic_load_n(&frame_sequence_, __ATOMIC_ACQUIRE);
+		uint32_t frames_published_ = sequence_ - task_read_sequence_;
+		task_read_sequence_ = sequence_;
+		return frames_published_ < 255 ? frames_published_ : 255;
+	}
+	#endif
+	uint8_t frames_parsed_ = read_frame_();
+	process_commands_();	//Time out or send queued commands without waiting for the radar
+	check_connection_(frames_parsed_);
+	process_calibration_();
+	process_adaptive_engineering_();
+	return frames_parsed_;
+}
+
+void ld2410::check_connection_(uint8_t frames_parsed)
+{
+	if(frames_parsed > 0)
+	{
+		connection_live_ = true;
+	}
+	else if(connection_live_ == true && millis() - radar_uart_last_packet_ >= LD2410_CONNECTION_TIMEOUT)
+	{
+		connection_live_ = false;
+		if(connection_lost_callback_ != nullptr)
+		{
+			connection_lost_callback_(*this, connection_lost_context_);
+		}
+	}
+}
+
+void ld2410::enableGateStatistics(bool enabled)
+{
+	lock_();
+	if(enabled == true && gate_statistics_enabled_ == false)
+	{
+		gate_statistics_.reset();
+	}
+	gate_statistics_enabled_ = enabled;
+	unlock_();
+}
+
+bool ld2410::takeGateStatistics(ld2410_gate_statistics &statistics, bool reset)
+{
+	lock_();	//The radar task may be part way through an update
+	statistics = gate_statistics_;
+	if(reset == true)
+	{
+		gate_statistics_.reset();
+	}
+	unlock_();
+	return statistics.frames() > 0;
+}
+
+void ld2410::onDataFrame(ld2410_frame_callback callback, void *context)
+{
+	lock_();	//So the radar task never sees a callback with the wrong context
+	data_frame_callback_ = callback;
+	data_frame_context_ = context;
+	unlock_();
+}
+
+void ld2410::onEngineeringFrame(ld2410_frame_callback callback, void *context)
+{
+	lock_();
+	engineering_frame_callback_ = callback;
+	engineering_frame_context_ = context;
+	unlock_();
+}
+
+void ld2410::onRawFrame(ld2410_raw_frame_callback callback, void *context)
 {
-	return read_frame_();
+	lock_();
+	raw_frame_callback_ = callback;
+	raw_frame_context_ = context;
+	unlock_();
+}
+
+void ld2410::setFrameClock(ld2410_clock_callback clock, void *context)
+{
+	lock_();
+	frame_clock_ = clock;
+	frame_clock_context_ = context;
+	unlock_();
+}
+
+void ld2410::onPresenceChange(ld2410_presence_callback callback, void *context)
+{
+	lock_();
+	presence_callback_ = callback;
+	presence_context_ = context;
+	unlock_();
+}
+
+void ld2410::onAck(ld2410_ack_callback callback, void *context)
+{
+	lock_();
+	ack_callback_ = callback;
+	ack_context_ = context;
+	unlock_();
+}
+
+void ld2410::onConnectionLost(ld2410_event_callback callback, void *context)
+{
+	lock_();
+	connection_lost_callback_ = callback;
+	connection_lost_context_ = context;
+	unlock_();
 }
 
 bool ld2410::presenceDetected()
 {
-	return target_type_ != 0;
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.presence;
+}
+
+void ld2410::setPresenceFilter(uint32_t debounceMs, uint32_t holdMs, uint8_t onEnergy, uint8_t offEnergy)
+{
+	lock_();
+	presence_debounce_ = debounceMs;
+	presence_hold_ = holdMs;
+	presence_on_energy_ = onEnergy;
+	presence_off_energy_ = offEnergy;
+	presence_pending_ = false;
+	unlock_();
+}
+
+bool ld2410::update_presence_(const ld2410_report &report)
+{
+	uint8_t energy_ = 0;
+	if(report.target_type & 0x01)
+	{
+		energy_ = report.moving_target_energy;
+	}
+	if((report.target_type & 0x02) && report.stationary_target_energy > energy_)
+	{
+		energy_ = report.stationary_target_energy;
+	}
+	bool detected_ = report.target_type != 0 && energy_ >= (presence_ ? presence_off_energy_ : presence_on_energy_);	//Hysteresis, a target has to be stronger to start presence than to keep it
+	if(detected_ == presence_)
+	{
+		presence_pending_ = false;
+		return false;
+	}
+	uint32_t frame_time_ = report.timestamp_us / 1000;	//Frame time rather than millis(), so a backlog of frames is filtered as it arrived
+	if(presence_pending_ == false)
+	{
+		presence_pending_ = true;
+		presence_pending_since_ = frame_time_;
+	}
+	if(frame_time_ - presence_pending_since_ < (detected_ ? presence_debounce_ : presence_hold_))
+	{
+		return false;
+	}
+	presence_ = detected_;
+	presence_pending_ = false;
+	return true;
 }
 
 bool ld2410::stationaryTargetDetected()
 {
-	if((target_type_ & 0x02) && stationary_target_distance_ > 0 && stationary_target_energy_ > 0)
+	ld2410_report report_;
+	latestReport(report_);
+	if((report_.target_type & 0x02) && report_.stationary_target_distance > 0 && report_.stationary_target_energy > 0)
 	{
 		return true;
 	}
@@ -112,25 +600,23 @@ bool ld2410::stationaryTargetDetected()
 
 uint16_t ld2410::stationaryTargetDistance()
 {
-	//if(stationary_target_energy_ > 0)
-	{
-		return stationary_target_distance_;
-	}
-	//return 0;
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.stationary_target_distance;
 }
 
 uint8_t ld2410::stationaryTargetEnergy()
 {
-	//if(stationary_target_distance_ > 0)
-	{
-		return stationary_target_energy_;
-	}
-	//return 0;
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.stationary_target_energy;
 }
 
 bool ld2410::movingTargetDetected()
 {
-	if((target_type_ & 0x01) && moving_target_distance_ > 0 && moving_target_energy_ > 0)
+	ld2410_report report_;
+	latestReport(report_);
+	if((report_.target_type & 0x01) && report_.moving_target_distance > 0 && report_.moving_target_energy > 0)
 	{
 		return true;
 	}
@@ -139,169 +625,437 @@ bool ld2410::movingTargetDetected()
 
 uint16_t ld2410::movingTargetDistance()
 {
-	//if(moving_target_energy_ > 0)
-	{
-		return moving_target_distance_;
-	}
-	//return 0;
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.moving_target_distance;
 }
 
 uint8_t ld2410::movingTargetEnergy()
 {
-	//if(moving_target_distance_ > 0)
-	{
-		return moving_target_energy_;
-	}
-	//return 0;
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.moving_target_energy;
+}
+
+uint8_t ld2410::lightLevel()
+{
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.light_level;
+}
+
+bool ld2410::outPinState()
+{
+	ld2410_report report_;
+	latestReport(report_);
+	return report_.out_pin;
 }
 
-bool ld2410::read_frame_()
+void ld2410::publish_report_(bool engineering)
 {
-	if(radar_uart_ -> available())
+	ld2410_report &report = history_[(frame_sequence_ + 1) & (LD2410_HISTORY_LENGTH - 1)];	//Overwrites the oldest frame kept
+	report.sequence = frame_sequence_ + 1;
+	report.timestamp_us = frame_start_us_;
+	counters_.data_frames++;
+	LD2410_TRACE_EVENT(LD2410_TRACE_DATA_FRAME, engineering, radar_data_frame_position_);
+	report.engineering = engineering;
+	const ld2410_target_data &target_ = basic_frame_.target;	//Read in place, the frame buffer isn't touched until this returns
+	report.target_type = target_.target_state;
+	report.moving_target_distance = target_.moving_target_distance;
+	report.moving_target_energy = target_.moving_target_energy;
+	report.stationary_target_distance = target_.stationary_target_distance;
+	report.stationary_target_energy = target_.stationary_target_energy;
+	report.detection_distance = target_.detection_distance;
+	if(engineering == true)
 	{
-		if(frame_started_ == false)
+		memcpy(report.moving_energy, engineering_frame_.moving_energy, sizeof(report.moving_energy));
+		memcpy(report.stationary_energy, engineering_frame_.stationary_energy, sizeof(report.stationary_energy));
+		bool extended_ = engineering_frame_.length >= offsetof(ld2410_engineering_frame, tail) + 2 - 6;	//Has the light level and OUT pin
+		report.light_level = extended_ ? engineering_frame_.light_level : 0;
+		report.out_pin = extended_ && engineering_frame_.out_pin != 0;
+		memcpy(engineering_moving_energy, engineering_frame_.moving_energy, sizeof(engineering_moving_energy));
+		memcpy(engineering_stationary_energy, engineering_frame_.stationary_energy, sizeof(engineering_stationary_energy));
+		engineering_moving_target_gate = engineering_frame_.moving_max_gate;
+		engineering_stationary_target_gate = engineering_frame_.stationary_max_gate;
+		if(gate_statistics_enabled_ == true)
 		{
-			uint8_t byte_read_ = radar_uart_ -> read();
-			if(byte_read_ == 0xF4)
-			{
-				#ifdef LD2410_DEBUG_DATA
-				if(debug_uart_ != nullptr)
-				{
-					debug_uart_->print(F("\nRcvd : 00 "));
-				}
-				#endif
-				radar_data_frame_[radar_data_frame_position_++] = byte_read_;
-				frame_started_ = true;
-				ack_frame_ = false;
-			}
-			else if(byte_read_ == 0xFD)
-			{
-				#ifdef LD2410_DEBUG_COMMANDS
-				if(debug_uart_ != nullptr)
-				{
-					debug_uart_->print(F("\nRcvd : 00 "));
-				}
-				#endif
-				radar_data_frame_[radar_data_frame_position_++] = byte_read_;
-				frame_started_ = true;
-				ack_frame_ = true;
-			}
+			gate_statistics_.update(report.moving_energy, report.stationary_energy);
 		}
-		else
+		if(calibration_recording_ == true)
 		{
-			if(radar_data_frame_position_ < LD2410_MAX_FRAME_LENGTH)
+			if(calibration_statistics_.frames() == 0)
 			{
-				#ifdef LD2410_DEBUG_DATA
-				if(debug_uart_ != nullptr && ack_frame_ == false)
-				{
-					if(radar_data_frame_position_ < 0x10)
-					{
-						debug_uart_->print('0');
-					}
-					debug_uart_->print(radar_data_frame_position_, HEX);
-					debug_uart_->print(' ');
-				}
-				#endif
-				#ifdef LD2410_DEBUG_COMMANDS
-				if(debug_uart_ != nullptr && ack_frame_ == true)
-				{
-					if(radar_data_frame_position_ < 0x10)
-					{
-						debug_uart_->print('0');
-					}
-					debug_uart_->print(radar_data_frame_position_, HEX);
-					debug_uart_->print(' ');
-				}
-				#endif
-				radar_data_frame_[radar_data_frame_position_++] = radar_uart_ -> read();
-				if(radar_data_frame_position_ > 7)	//Can check for start and end
-				{
-					if(	radar_data_frame_[0]                              == 0xF4 &&	//Data frame end state
-						radar_data_frame_[1]                              == 0xF3 &&
-						radar_data_frame_[2]                              == 0xF2 &&
-						radar_data_frame_[3]                              == 0xF1 &&
-						radar_data_frame_[radar_data_frame_position_ - 4] == 0xF8 &&
-						radar_data_frame_[radar_data_frame_position_ - 3] == 0xF7 &&
-						radar_data_frame_[radar_data_frame_position_ - 2] == 0xF6 &&
-						radar_data_frame_[radar_data_frame_position_ - 1] == 0xF5
-					)
-					{
-						if(parse_data_frame_())
-						{
-							#ifdef LD2410_DEBUG_DATA
-							if(debug_uart_ != nullptr)
-							{
-								debug_uart_->print(F("parsed data OK"));
-							}
-							#endif
-							frame_started_ = false;
-							radar_data_frame_position_ = 0;
-							return true;
-						}
-						else
-						{
-							#ifdef LD2410_DEBUG_DATA
-							if(debug_uart_ != nullptr)
-							{
-								debug_uart_->print(F("failed to parse data"));
-							}
-							#endif
-							frame_started_ = false;
-							radar_data_frame_position_ = 0;
-						}
-					}
-					else if(radar_data_frame_[0]                              == 0xFD &&	//Command frame end state
-							radar_data_frame_[1]                              == 0xFC &&
-							radar_data_frame_[2]                              == 0xFB &&
-							radar_data_frame_[3]                              == 0xFA &&
-							radar_data_frame_[radar_data_frame_position_ - 4] == 0x04 &&
-							radar_data_frame_[radar_data_frame_position_ - 3] == 0x03 &&
-							radar_data_frame_[radar_data_frame_position_ - 2] == 0x02 &&
-							radar_data_frame_[radar_data_frame_position_ - 1] == 0x01
-						)
-					{
-						if(parse_command_frame_())
-						{
-							#ifdef LD2410_DEBUG_COMMANDS
-							if(debug_uart_ != nullptr)
-							{
-								debug_uart_->print(F("parsed command OK"));
-							}
-							#endif
-							frame_started_ = false;
-							radar_data_frame_position_ = 0;
-							return true;
-						}
-						else
-						{
-							#ifdef LD2410_DEBUG_COMMANDS
-							if(debug_uart_ != nullptr)
-							{
-								debug_uart_->print(F("failed to parse command"));
-							}
-							#endif
-							frame_started_ = false;
-							radar_data_frame_position_ = 0;
-						}
-					}
-				}
+				calibration_started_ = millis();	//The window starts once the radar is in engineering mode
+			}
+			calibration_statistics_.update(report.moving_energy, report.stationary_energy);
+		}
+	}
+	else
+	{
+		memset(report.moving_energy, 0, sizeof(report.moving_energy));
+		memset(report.stationary_energy, 0, sizeof(report.stationary_energy));
+		report.light_level = 0;
+		report.out_pin = false;
+	}
+	bool presence_changed_ = update_presence_(report);
+	report.presence = presence_;
+	__atomic_store_n(&frame_sequence_, frame_sequence_ + 1, __ATOMIC_RELEASE);	//Publish only once the slot is complete
+	if(data_frame_callback_ != nullptr)
+	{
+		data_frame_callback_(*this, report, data_frame_context_);
+	}
+	if(engineering == true && engineering_frame_callback_ != nullptr)
+	{
+		engineering_frame_callback_(*this, report, engineering_frame_context_);
+	}
+	if(presence_changed_ == true && presence_callback_ != nullptr)
+	{
+		presence_callback_(*this, presence_, presence_context_);
+	}
+}
+
+bool ld2410::latestReport(ld2410_report &report)
+{
+	uint32_t sequence_;
+	do	//Seqlock over the history: the copy is good unless the writer wrapped round to this slot meanwhile
+	{
+		sequence_ = __atomic_load_n(&frame_sequence_, __ATOMIC_ACQUIRE);
+		report = history_[sequence_ & (LD2410_HISTORY_LENGTH - 1)];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while(__atomic_load_n(&frame_sequence_, __ATOMIC_RELAXED) - sequence_ >= LD2410_HISTORY_LENGTH - 1);
+	return sequence_ != 0;
+}
+
+uint32_t ld2410::frameSequence()
+{
+	return __atomic_load_n(&frame_sequence_, __ATOMIC_ACQUIRE);
+}
+
+bool ld2410::historyReport(ld2410_report &report, uint16_t age)
+{
+	uint32_t sequence_;
+	do	//Same seqlock as latestReport()
+	{
+		sequence_ = frameSequence();
+		if(age >= LD2410_HISTORY_LENGTH - 1 || age >= sequence_)
+		{
+			return false;
+		}
+		report = history_[(sequence_ - age) & (LD2410_HISTORY_LENGTH - 1)];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while(__atomic_load_n(&frame_sequence_, __ATOMIC_RELAXED) - (sequence_ - age) >= LD2410_HISTORY_LENGTH - 1);
+	return true;
+}
+
+uint16_t ld2410::reportsAvailable()
+{
+	uint32_t unread_ = frameSequence() - history_read_sequence_;
+	return unread_ < LD2410_HISTORY_LENGTH - 1 ? unread_ : LD2410_HISTORY_LENGTH - 1;
+}
+
+bool ld2410::popReport(ld2410_report &report)
+{
+	for(;;)
+	{
+		uint32_t sequence_ = frameSequence();
+		if(history_read_sequence_ == sequence_)
+		{
+			return false;
+		}
+		if(sequence_ - history_read_sequence_ > LD2410_HISTORY_LENGTH - 1)	//The consumer fell behind, skip to the oldest frame still kept. The slot after the latest is the next one written
+		{
+			reports_dropped_ += sequence_ - history_read_sequence_ - (LD2410_HISTORY_LENGTH - 1);
+			history_read_sequence_ = sequence_ - (LD2410_HISTORY_LENGTH - 1);
+		}
+		uint32_t wanted_ = history_read_sequence_ + 1;
+		report = history_[wanted_ & (LD2410_HISTORY_LENGTH - 1)];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&frame_sequence_, __ATOMIC_RELAXED) - wanted_ < LD2410_HISTORY_LENGTH - 1)
+		{
+			history_read_sequence_ = wanted_;
+			return true;
+		}
+		//The writer reached this slot during the copy, go round again and skip past it
+	}
+}
+
+uint32_t ld2410::reportsDropped()
+{
+	return reports_dropped_;
+}
+
+void ld2410::getCounters(ld2410_counters &counters)
+{
+	lock_();	//The radar task updates them as it parses
+	counters = counters_;
+	unlock_();
+}
+
+void ld2410::resetCounters()
+{
+	lock_();
+	counters_ = ld2410_counters();
+	unlock_();
+}
+
+uint8_t ld2410::read_frame_()
+{
+	uint32_t start_cycles_ = ld2410_cycle_count_();
+	uint8_t frames_parsed_ = 0;
+	#if defined(ESP32)
+	if(receive_events_ == true)
+	{
+		uint16_t bytes_available_ = radar_rx_ring_.available();	//Bytes have already been moved off the UART, parse them from memory
+		if(bytes_available_ > counters_.uart_high_water)
+		{
+			counters_.uart_high_water = bytes_available_;
+		}
+		while(bytes_available_ > 0)
+		{
+			uint16_t bytes_read_ = radar_rx_ring_.read(radar_uart_buffer_, bytes_available_ < LD2410_UART_BUFFER_SIZE ? bytes_available_ : LD2410_UART_BUFFER_SIZE);
+			frames_parsed_ += parse_block_(radar_uart_buffer_, bytes_read_);
+			bytes_available_ -= bytes_read_;
+		}
+	}
+	else
+	#endif
+	{
+		int bytes_available_ = radar_uart_ -> available();	//Drain only what is already buffered, so this can't spin on a busy UART
+		if(bytes_available_ > counters_.uart_high_water)
+		{
+			counters_.uart_high_water = bytes_available_;
+		}
+		while(bytes_available_ > 0)
+		{
+			size_t bytes_read_ = radar_uart_ -> readBytes(radar_uart_buffer_, bytes_available_ < LD2410_UART_BUFFER_SIZE ? bytes_available_ : LD2410_UART_BUFFER_SIZE);
+			if(bytes_read_ == 0)
+			{
+				break;
+			}
+			frames_parsed_ += parse_block_(radar_uart_buffer_, bytes_read_);
+			bytes_available_ -= bytes_read_;
+		}
+	}
+	if(frames_parsed_ > 0)
+	{
+		uint32_t cycles_ = ld2410_cycle_count_() - start_cycles_;
+		if(counters_.parse_passes == 0 || cycles_ < counters_.parse_cycles_min)
+		{
+			counters_.parse_cycles_min = cycles_;
+		}
+		if(cycles_ > counters_.parse_cycles_max)
+		{
+			counters_.parse_cycles_max = cycles_;
+		}
+		counters_.parse_cycles_total += cycles_;
+		counters_.parse_passes++;
+	}
+	return frames_parsed_;
+}
+
+uint8_t ld2410::parse_block_(const uint8_t *block, size_t length)
+{
+	uint8_t frames_parsed_ = 0;
+	counters_.bytes_received += length;
+	for(size_t i = 0; i < length; i++)
+	{
+		frames_parsed_ += parse_byte_(block[i]);
+	}
+	return frames_parsed_;
+}
+
+uint8_t ld2410::parse_byte_(uint8_t byte_read_)
+{
+	if(frame_started_ == false)
+	{
+		if(byte_read_ != 0xF4 && byte_read_ != 0xFD)
+		{
+			counters_.bytes_discarded++;
+			return 0;
+		}
+		start_frame_(byte_read_);
+	}
+	else
+	{
+		#ifdef LD2410_DEBUG_DATA
+		if(debug_uart_ != nullptr && ack_frame_ == false)
+		{
+			if(radar_data_frame_position_ < 0x10)
+			{
+				debug_uart_->print('0');
 			}
-			else
+			debug_uart_->print(radar_data_frame_position_, HEX);
+			debug_uart_->print(' ');
+		}
+		#endif
+		#ifdef LD2410_DEBUG_COMMANDS
+		if(debug_uart_ != nullptr && ack_frame_ == true)
+		{
+			if(radar_data_frame_position_ < 0x10)
 			{
-				#if defined(LD2410_DEBUG_DATA) || defined(LD2410_DEBUG_COMMANDS)
-				if(debug_uart_ != nullptr)
-				{
-					debug_uart_->print(F("\nLD2410 frame overran"));
-				}
-				#endif
-				frame_started_ = false;
-				radar_data_frame_position_ = 0;
+				debug_uart_->print('0');
 			}
+			debug_uart_->print(radar_data_frame_position_, HEX);
+			debug_uart_->print(' ');
 		}
+		#endif
+	}
+	radar_data_frame_[radar_data_frame_position_++] = byte_read_;
+	return scan_frame_(false);
+}
+
+void ld2410::start_frame_(uint8_t first_byte)
+{
+	ack_frame_ = (first_byte == 0xFD);
+	frame_start_us_ = frame_clock_ != nullptr ? frame_clock_(frame_clock_context_) : ld2410_timestamp_us_();	//Capture time of the frame, taken as its header starts
+	#ifdef LD2410_DEBUG_DATA
+	if(debug_uart_ != nullptr && ack_frame_ == false)
+	{
+		debug_uart_->print(F("\nRcvd : 00 "));
+	}
+	#endif
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr && ack_frame_ == true)
+	{
+		debug_uart_->print(F("\nRcvd : 00 "));
+	}
+	#endif
+	frame_started_ = true;
+}
+
+uint8_t ld2410::scan_frame_(bool rescan)
+{
+	uint8_t frames_parsed_ = 0;
+	while(radar_data_frame_position_ > 0)
+	{
+		const uint8_t *header_ = ack_frame_ ? ld2410_command_header_ : ld2410_data_header_;
+		if(rescan == true || radar_data_frame_position_ <= 4)	//Bytes already checked don't change as more arrive
+		{
+			uint8_t checked_ = radar_data_frame_position_ < 4 ? radar_data_frame_position_ : 4;
+			if(memcmp(radar_data_frame_, header_, checked_) != 0)
+			{
+				counters_.bytes_discarded++;
+				shift_frame_(1);
+				rescan = true;
+				continue;
+			}
+		}
+		if(radar_data_frame_position_ < 6)
+		{
+			break;
+		}
+		uint16_t frame_length_ = radar_data_frame_[4] + (radar_data_frame_[5] << 8) + 10;	//The header's length field says exactly where the footer is
+		if(frame_length_ > LD2410_MAX_FRAME_LENGTH)
+		{
+			#if defined(LD2410_DEBUG_DATA) || defined(LD2410_DEBUG_COMMANDS)
+			if(debug_uart_ != nullptr)
+			{
+				debug_uart_->print(F("\nLD2410 frame overran"));
+			}
+			#endif
+			counters_.frame_overruns++;
+			LD2410_TRACE_EVENT(LD2410_TRACE_FRAME_OVERRUN, radar_data_frame_[0], frame_length_);
+			counters_.bytes_discarded++;
+			shift_frame_(1);	//A corrupt length, start looking again just past this header
+			rescan = true;
+			continue;
+		}
+		if(radar_data_frame_position_ < frame_length_)
+		{
+			break;
+		}
+		uint8_t buffered_ = radar_data_frame_position_;
+		radar_data_frame_position_ = frame_length_;	//Parse just this frame, anything buffered after it is kept
+		const uint8_t *footer_ = ack_frame_ ? ld2410_command_tail_ : ld2410_data_tail_;
+		if(memcmp(radar_data_frame_ + frame_length_ - 4, footer_, 4) == 0)
+		{
+			if(dispatch_frame_())
+			{
+				frames_parsed_++;
+			}
+			radar_data_frame_position_ = buffered_;
+			shift_frame_(frame_length_);
+		}
+		else
+		{
+			#if defined(LD2410_DEBUG_DATA) || defined(LD2410_DEBUG_COMMANDS)
+			if(debug_uart_ != nullptr)
+			{
+				debug_uart_->print(F("\nLD2410 frame footer missing, resynchronising"));
+			}
+			#endif
+			counters_.length_mismatches++;
+			LD2410_TRACE_EVENT(LD2410_TRACE_FRAME_LENGTH, radar_data_frame_[6], frame_length_);
+			radar_data_frame_position_ = buffered_;
+			counters_.bytes_discarded++;
+			shift_frame_(1);	//The next frame's header may be inside what was buffered
+		}
+		rescan = true;
+	}
+	return frames_parsed_;
+}
+
+void ld2410::shift_frame_(uint8_t start)
+{
+	uint8_t next_ = start;
+	while(next_ < radar_data_frame_position_ && radar_data_frame_[next_] != 0xF4 && radar_data_frame_[next_] != 0xFD)
+	{
+		next_++;
+	}
+	counters_.bytes_discarded += next_ - start;
+	radar_data_frame_position_ -= next_;
+	memmove(radar_data_frame_, radar_data_frame_ + next_, radar_data_frame_position_);
+	frame_started_ = false;
+	if(radar_data_frame_position_ > 0)
+	{
+		start_frame_(radar_data_frame_[0]);
 	}
-	return false;
 }
 
+bool ld2410::dispatch_frame_()
+{
+	if(ack_frame_ == false)
+	{
+		if(parse_data_frame_())
+		{
+			#ifdef LD2410_DEBUG_DATA
+			if(debug_uart_ != nullptr)
+			{
+				debug_uart_->print(F("parsed data OK"));
+			}
+			#endif
+			if(raw_frame_callback_ != nullptr)
+			{
+				raw_frame_callback_(*this, radar_data_frame_, radar_data_frame_position_, frame_start_us_, frame_sequence_, raw_frame_context_);
+			}
+			return true;
+		}
+		#ifdef LD2410_DEBUG_DATA
+		if(debug_uart_ != nullptr)
+		{
+			debug_uart_->print(F("failed to parse data"));
+		}
+		#endif
+		return false;
+	}
+	bool command_parsed_ = parse_command_frame_();
+	acknowledge_command_(command_parsed_);
+	if(command_parsed_ == true && raw_frame_callback_ != nullptr)
+	{
+		raw_frame_callback_(*this, radar_data_frame_, radar_data_frame_position_, frame_start_us_, frame_sequence_, raw_frame_context_);
+	}
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(command_parsed_ ? F("parsed command OK") : F("failed to parse command"));
+	}
+	#endif
+	return command_parsed_;
+}
+
+#ifdef LD2410_DEBUG_ANY
 void ld2410::print_frame_()
 {
 	if(debug_uart_ != nullptr)
@@ -325,6 +1079,7 @@ void ld2410::print_frame_()
 		}
 	}
 }
+#endif
 
 bool ld2410::parse_data_frame_()
 {
@@ -343,133 +1098,67 @@ bool ld2410::parse_data_frame_()
 			print_frame_();
 		}
 		#endif
-		if(radar_data_frame_[6] == 0x01 && radar_data_frame_[7] == 0xAA)	//Engineering mode data
-		{
-			target_type_ = radar_data_frame_[8];
-			
-			// Engineering mode frame structure (from aio-ld2410):
-			// Header: F4 F3 F2 F1 (4 bytes)
-			// Length: 2 bytes (intra_frame_data_length_)
-			// Byte 6: report type (0x01 for engineering)
-			// Byte 7: head (0xAA)
-			// Bytes 8-15: Basic report (8 bytes)
-			//   - target_status, moving_distance (2), moving_energy, static_distance (2), static_energy, detection_distance (2)
-			// Bytes 16-38: Engineering report (23 bytes)
-			//   - moving_max_distance_gate, static_max_distance_gate
-			//   - moving_gate_energy[9], static_gate_energy[9]
-			//   - photosensitive_value, out_pin_status
-			// Byte 39: tail (0x55)
-			// Byte 40: calibration (0x00)
-			// Footer: F8 F7 F6 F5 (4 bytes)
-			
-			// Parse basic data
-			moving_target_distance_ = radar_data_frame_[9] + (radar_data_frame_[10] << 8);
-			moving_target_energy_ = radar_data_frame_[11];
-			stationary_target_distance_ = radar_data_frame_[12] + (radar_data_frame_[13] << 8);
-			stationary_target_energy_ = radar_data_frame_[14];
-			
-			if(intra_frame_data_length_ >= 33)  // Full engineering frame
-			{
-				// Engineering data starts at byte 16
-				engineering_moving_target_gate = radar_data_frame_[16];
-				engineering_stationary_target_gate = radar_data_frame_[17];
-				
-				// Moving energies: bytes 18-26 (9 bytes)
-				for(int i = 0; i < 9; i++)
-				{
-					engineering_moving_energy[i] = radar_data_frame_[18 + i];
-				}
-				// Stationary energies: bytes 27-35 (9 bytes)
-				for(int i = 0; i < 9; i++)
-				{
-					engineering_stationary_energy[i] = radar_data_frame_[27 + i];
-				}
-			}
-			
-			#ifdef LD2410_DEBUG_PARSE
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("\nEngineering data - "));
-				if(target_type_ == 0x00)
-				{
-					debug_uart_->print(F("no target"));
-				}
-				else if(target_type_ == 0x01)
-				{
-					debug_uart_->print(F("moving target:"));
-				}
-				else if(target_type_ == 0x02)
-				{
-					debug_uart_->print(F("stationary target:"));
-				}
-				else if(target_type_ == 0x03)
-				{
-					debug_uart_->print(F("moving & stationary targets:"));
-				}
-				debug_uart_->print(F(" Gates M["));
-				for(int i = 0; i < 9; i++)
-				{
-					debug_uart_->print(engineering_moving_energy[i]);
-					if(i < 8) debug_uart_->print(',');
-				}
-				debug_uart_->print(F("] S["));
-				for(int i = 0; i < 9; i++)
-				{
-					debug_uart_->print(engineering_stationary_energy[i]);
-					if(i < 8) debug_uart_->print(',');
-				}
-				debug_uart_->print(F("]"));
-			}
-			#endif
-			radar_uart_last_packet_ = millis();
-			return true;
-		}
-		else if(intra_frame_data_length_ == 13 && radar_data_frame_[6] == 0x02 && radar_data_frame_[7] == 0xAA && radar_data_frame_[17] == 0x55 && radar_data_frame_[18] == 0x00)	//Normal target data
+		uint8_t tail_ = radar_data_frame_[6 + intra_frame_data_length_ - 2];	//Whatever the frame type, the tail and check come last
+		uint8_t check_ = radar_data_frame_[6 + intra_frame_data_length_ - 1];
+		bool engineering_ = (engineering_frame_.type == 0x01 && intra_frame_data_length_ >= offsetof(ld2410_engineering_frame, light_level) + 2 - 6);	//Older firmware stops after the gate energies
+		bool basic_ = (basic_frame_.type == 0x02 && intra_frame_data_length_ == sizeof(ld2410_basic_frame) - 10);
+		if((engineering_ == true || basic_ == true) && basic_frame_.head == 0xAA && tail_ == 0x55 && check_ == 0x00)
 		{
-			target_type_ = radar_data_frame_[8];
-			//moving_target_distance_ = radar_data_frame_[9] + (radar_data_frame_[10] << 8);
-			stationary_target_distance_ = radar_data_frame_[9] + (radar_data_frame_[10] << 8);
-			stationary_target_energy_ = radar_data_frame_[14];
-			moving_target_energy_ = radar_data_frame_[11];
-			//stationary_target_distance_ = radar_data_frame_[12] + (radar_data_frame_[13] << 8);
-			moving_target_distance_ = radar_data_frame_[15] + (radar_data_frame_[16] << 8);
 			#ifdef LD2410_DEBUG_PARSE
 			if(debug_uart_ != nullptr)
 			{
-				debug_uart_->print(F("\nNormal data - "));
-				if(target_type_ == 0x00)
+				const ld2410_target_data &target_ = basic_frame_.target;	//Same place in both frame types
+				debug_uart_->print(engineering_ ? F("\nEngineering data - ") : F("\nNormal data - "));
+				if(target_.target_state == 0x00)
 				{
 					debug_uart_->print(F("no target"));
 				}
-				else if(target_type_ == 0x01)
+				else if(target_.target_state == 0x01)
 				{
 					debug_uart_->print(F("moving target:"));
 				}
-				else if(target_type_ == 0x02)
+				else if(target_.target_state == 0x02)
 				{
 					debug_uart_->print(F("stationary target:"));
 				}
-				else if(target_type_ == 0x03)
+				else if(target_.target_state == 0x03)
 				{
 					debug_uart_->print(F("moving & stationary targets:"));
 				}
-				if(radar_data_frame_[8] & 0x01)
+				if(target_.target_state & 0x01)
 				{
 					debug_uart_->print(F(" moving at "));
-					debug_uart_->print(moving_target_distance_);
+					debug_uart_->print(target_.moving_target_distance);
 					debug_uart_->print(F("cm power "));
-					debug_uart_->print(moving_target_energy_);
+					debug_uart_->print(target_.moving_target_energy);
 				}
-				if(radar_data_frame_[8] & 0x02)
+				if(target_.target_state & 0x02)
 				{
 					debug_uart_->print(F(" stationary at "));
-					debug_uart_->print(stationary_target_distance_);
+					debug_uart_->print(target_.stationary_target_distance);
 					debug_uart_->print(F("cm power "));
-					debug_uart_->print(stationary_target_energy_);
+					debug_uart_->print(target_.stationary_target_energy);
+				}
+				if(engineering_ == true)
+				{
+					debug_uart_->print(F(" Gates M["));
+					for(int i = 0; i < 9; i++)
+					{
+						debug_uart_->print(engineering_frame_.moving_energy[i]);
+						if(i < 8) debug_uart_->print(',');
+					}
+					debug_uart_->print(F("] S["));
+					for(int i = 0; i < 9; i++)
+					{
+						debug_uart_->print(engineering_frame_.stationary_energy[i]);
+						if(i < 8) debug_uart_->print(',');
+					}
+					debug_uart_->print(F("]"));
 				}
 			}
 			#endif
 			radar_uart_last_packet_ = millis();
+			publish_report_(engineering_);
 			return true;
 		}
 		else
@@ -478,9 +1167,11 @@ bool ld2410::parse_data_frame_()
 			if(debug_uart_ != nullptr)
 			{
 				debug_uart_->print(F("\nUnknown frame type"));
+				print_frame_();
 			}
 			#endif
-			print_frame_();
+			counters_.unknown_frames++;
+			LD2410_TRACE_EVENT(LD2410_TRACE_UNKNOWN_FRAME, radar_data_frame_[6], radar_data_frame_position_);
 		}
 	}
 	else
@@ -494,10 +1185,59 @@ bool ld2410::parse_data_frame_()
 			debug_uart_->print(intra_frame_data_length_ + 10);
 		}
 		#endif
+		counters_.length_mismatches++;
+		LD2410_TRACE_EVENT(LD2410_TRACE_FRAME_LENGTH, radar_data_frame_[6], radar_data_frame_position_);
 	}
 	return false;
 }
 
+const ld2410::ack_handler_ ld2410::ack_handlers_[48] = {
+	{4, nullptr},									//0x60 set max values
+	{28, &ld2410::parse_configuration_ack_},		//0x61 read configuration
+	{4, nullptr},									//0x62 enable engineering mode
+	{4, nullptr},									//0x63 disable engineering mode
+	{4, nullptr},									//0x64 set gate sensitivity
+	{0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr},	//0x65-0x6F
+	{12, &ld2410::parse_firmware_ack_},				//0xA0 read firmware version
+	{4, nullptr},									//0xA1 set baud rate
+	{4, nullptr},									//0xA2 factory reset
+	{4, nullptr},									//0xA3 restart
+	{4, nullptr},									//0xA4 Bluetooth on/off
+	{10, &ld2410::parse_mac_address_ack_},			//0xA5 read MAC address
+	{0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr},	//0xA6-0xA9
+	{4, nullptr},									//0xAA set distance resolution
+	{6, &ld2410::parse_distance_resolution_ack_},	//0xAB read distance resolution
+	{0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr},	//0xAC-0xAF
+	{0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr}, {0, nullptr},	//0xF0-0xFD
+	{4, nullptr},									//0xFE leave configuration mode
+	{8, nullptr}									//0xFF enter configuration mode
+};
+
+const ld2410::ack_handler_ *ld2410::find_ack_handler_(uint8_t command)
+{
+	uint8_t index_;
+	switch(command >> 4)	//Commands only come in these three blocks of 16
+	{
+		case 0x6:
+			index_ = 0;
+			break;
+		case 0xA:
+			index_ = 16;
+			break;
+		case 0xF:
+			index_ = 32;
+			break;
+		default:
+			return nullptr;
+	}
+	const ack_handler_ *handler_ = &ack_handlers_[index_ + (command & 0x0F)];
+	if(handler_->length == 0)
+	{
+		return nullptr;
+	}
+	return handler_;
+}
+
 bool ld2410::parse_command_frame_()
 {
 	uint16_t intra_frame_data_length_ = radar_data_frame_[4] + (radar_data_frame_[5] << 8);
@@ -512,716 +1252,921 @@ bool ld2410::parse_command_frame_()
 	#endif
 	latest_ack_ = radar_data_frame_[6];
 	latest_command_success_ = (radar_data_frame_[8] == 0x00 && radar_data_frame_[9] == 0x00);
-	if(intra_frame_data_length_ == 8 && latest_ack_ == 0xFF)
+	const ack_handler_ *handler_ = find_ack_handler_(latest_ack_);
+	if(handler_ == nullptr)
 	{
 		#ifdef LD2410_DEBUG_COMMANDS
 		if(debug_uart_ != nullptr)
 		{
-			debug_uart_->print(F("\nACK for entering configuration mode: "));
+			debug_uart_->print(F("\nUnknown ACK"));
 		}
 		#endif
-		if(latest_command_success_)
-		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
-		}
-		else
-		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
-		}
+		return false;
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0xFE)
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
+		debug_uart_->print(F("\nACK for command 0x"));
+		debug_uart_->print(latest_ack_, HEX);
+		debug_uart_->print(F(": "));
+	}
+	#endif
+	if(latest_command_success_ == false || intra_frame_data_length_ != handler_->length)	//A failed command may ACK with just the status
+	{
+		#ifdef LD2410_DEBUG_COMMANDS
+		if(debug_uart_ != nullptr)
 		{
-			debug_uart_->print(F("\nACK for leaving configuration mode: "));
+			debug_uart_->print(F("failed"));
 		}
 		#endif
-		if(latest_command_success_)
+		return false;
+	}
+	radar_uart_last_packet_ = millis();
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(F("OK"));
+	}
+	#endif
+	if(handler_->parse != nullptr)
+	{
+		(this->*handler_->parse)();
+	}
+	return true;
+}
+
+void ld2410::parse_configuration_ack_()
+{
+	max_gate = radar_data_frame_[11];
+	max_moving_gate = radar_data_frame_[12];
+	max_stationary_gate = radar_data_frame_[13];
+	for(uint8_t i = 0; i < 9; i++)
+	{
+		motion_sensitivity[i] = radar_data_frame_[14 + i];
+		stationary_sensitivity[i] = radar_data_frame_[23 + i];
+	}
+	sensor_idle_time = radar_data_frame_[32];
+	sensor_idle_time += (radar_data_frame_[33] << 8);
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(F("\nMax gate distance: "));
+		debug_uart_->print(max_gate);
+		debug_uart_->print(F("\nMax motion detecting gate distance: "));
+		debug_uart_->print(max_moving_gate);
+		debug_uart_->print(F("\nMax stationary detecting gate distance: "));
+		debug_uart_->print(max_stationary_gate);
+		debug_uart_->print(F("\nSensitivity per gate"));
+		for(uint8_t i = 0; i < 9; i++)
 		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
+			debug_uart_->print(F("\nGate "));
+			debug_uart_->print(i);
+			debug_uart_->print(F(" ("));
+			debug_uart_->print(i * 0.75);
+			debug_uart_->print('-');
+			debug_uart_->print((i+1) * 0.75);
+			debug_uart_->print(F(" metres) Motion: "));
+			debug_uart_->print(motion_sensitivity[i]);
+			debug_uart_->print(F(" Stationary: "));
+			debug_uart_->print(stationary_sensitivity[i]);
+
 		}
-		else
+		debug_uart_->print(F("\nSensor idle timeout: "));
+		debug_uart_->print(sensor_idle_time);
+		debug_uart_->print('s');
+	}
+	#endif
+}
+
+void ld2410::parse_firmware_ack_()
+{
+	firmware_major_version = radar_data_frame_[13];
+	firmware_minor_version = radar_data_frame_[12];
+	firmware_bugfix_version = radar_data_frame_[14];
+	firmware_bugfix_version += radar_data_frame_[15]<<8;
+	firmware_bugfix_version += (uint32_t)radar_data_frame_[16]<<16;
+	firmware_bugfix_version += (uint32_t)radar_data_frame_[17]<<24;
+}
+
+void ld2410::parse_mac_address_ack_()
+{
+	for(uint8_t i = 0; i < 6; i++)
+	{
+		mac_address[i] = radar_data_frame_[10 + i];
+	}
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(F("\nMAC address: "));
+		for(uint8_t i = 0; i < 6; i++)
 		{
-			if(debug_uart_ != nullptr)
+			if(i > 0)
 			{
-				debug_uart_->print(F("failed"));
+				debug_uart_->print(':');
 			}
-			return false;
+			if(mac_address[i] < 0x10)
+			{
+				debug_uart_->print('0');
+			}
+			debug_uart_->print(mac_address[i], HEX);
+		}
+	}
+	#endif
+}
+
+void ld2410::parse_distance_resolution_ack_()
+{
+	distance_resolution = radar_data_frame_[10];
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
+	{
+		debug_uart_->print(F("\nDistance resolution: "));
+		debug_uart_->print(distance_resolution == LD2410_DISTANCE_RESOLUTION_20CM ? F("0.2m") : F("0.75m"));
+	}
+	#endif
+}
+
+
+uint8_t ld2410::submitCommand(uint8_t command, const uint8_t *value, uint8_t valueLength, ld2410_command_callback callback, void *context)
+{
+	lock_();
+	if(command_queue_length_ >= LD2410_COMMAND_QUEUE_LENGTH || valueLength > LD2410_MAX_COMMAND_VALUE_LENGTH)
+	{
+		unlock_();
+		return 0;
+	}
+	queued_command_ &entry = command_queue_[(command_queue_head_ + command_queue_length_) % LD2410_COMMAND_QUEUE_LENGTH];
+	entry.handle = next_command_handle_++;
+	if(next_command_handle_ == 0)	//Handle 0 means 'not queued'
+	{
+		next_command_handle_ = 1;
+	}
+	entry.command = command;
+	memcpy(entry.frame, ld2410_command_header_, sizeof(ld2410_command_header_));
+	entry.frame[4] = valueLength + 2;	//Command word plus value
+	entry.frame[5] = 0x00;
+	entry.frame[6] = command;
+	entry.frame[7] = 0x00;
+	if(valueLength > 0)
+	{
+		memcpy(entry.frame + LD2410_COMMAND_VALUE_OFFSET, value, valueLength);
+	}
+	memcpy(entry.frame + LD2410_COMMAND_VALUE_OFFSET + valueLength, ld2410_command_tail_, sizeof(ld2410_command_tail_));
+	entry.frame_length = LD2410_COMMAND_VALUE_OFFSET + valueLength + sizeof(ld2410_command_tail_);
+	entry.callback = callback;
+	entry.context = context;
+	entry.batched = false;
+	command_queue_length_++;
+	uint8_t handle = entry.handle;
+	unlock_();
+	#if defined(ESP32)
+	if(radar_task_running_())
+	{
+		xTaskNotifyGive(radar_task_);	//Send it now rather than at the next poll
+	}
+	#endif
+	return handle;
+}
+
+bool ld2410::commandPending(uint8_t handle)
+{
+	bool pending_ = false;
+	lock_();
+	for(uint8_t i = 0; i < command_queue_length_; i++)
+	{
+		if(command_queue_[(command_queue_head_ + i) % LD2410_COMMAND_QUEUE_LENGTH].handle == handle)
+		{
+			pending_ = true;
 		}
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0x60)
+	unlock_();
+	return pending_;
+}
+
+uint8_t ld2410::commandsPending()
+{
+	lock_();		//Also orders the caller after the radar task's callback writes
+	uint8_t pending_ = command_queue_length_;
+	unlock_();
+	return pending_;
+}
+
+void ld2410::process_commands_()
+{
+	if(waiting_for_ack_ == true && millis() - radar_uart_last_command_ >= radar_uart_command_timeout_)
 	{
 		#ifdef LD2410_DEBUG_COMMANDS
 		if(debug_uart_ != nullptr)
 		{
-			debug_uart_->print(F("\nACK for setting max values: "));
+			debug_uart_->print(F("\nNo ACK for command 0x"));
+			debug_uart_->print(command_queue_[command_queue_head_].command, HEX);
 		}
 		#endif
-		if(latest_command_success_)
+		counters_.command_timeouts++;
+		LD2410_TRACE_EVENT(LD2410_TRACE_COMMAND_TIMEOUT, command_queue_[command_queue_head_].command, command_queue_[command_queue_head_].handle);
+		complete_command_(false);
+	}
+	if(waiting_for_ack_ == false)
+	{
+		send_next_command_();
+	}
+}
+
+void ld2410::send_next_command_()
+{
+	while(configuration_failed_ == true && command_queue_length_ > 0 && command_queue_[command_queue_head_].command != 0xFE && command_queue_[command_queue_head_].command != 0xFF)	//Nothing inside a failed configuration session can work, but still send the leave command
+	{
+		complete_command_(false);
+	}
+	if(command_queue_length_ > 0)
+	{
+		send_queued_command_();
+	}
+}
+
+void ld2410::send_queued_command_()
+{
+	queued_command_ &entry = command_queue_[command_queue_head_];
+	if(entry.command == 0xFE || entry.command == 0xFF)	//A new configuration session, or the end of the failed one
+	{
+		configuration_failed_ = false;
+	}
+	radar_uart_->write(entry.frame, entry.frame_length);	//One write, so the frame goes out back to back
+	counters_.commands_sent++;
+	LD2410_TRACE_EVENT(LD2410_TRACE_COMMAND_SENT, entry.command, entry.handle);
+	radar_uart_last_command_ = millis();
+	waiting_for_ack_ = true;
+}
+
+void ld2410::acknowledge_command_(bool success)
+{
+	counters_.ack_frames++;
+	LD2410_TRACE_EVENT(LD2410_TRACE_ACK, radar_data_frame_[6], success);
+	if(radar_data_frame_[7] == 0x01 && ack_callback_ != nullptr)
+	{
+		ack_callback_(*this, radar_data_frame_[6], success, ack_context_);
+	}
+	if(waiting_for_ack_ == true && radar_data_frame_[7] == 0x01 && latest_ack_ == command_queue_[command_queue_head_].command)
+	{
+		complete_command_(success);
+		if(waiting_for_ack_ == false)
 		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
+			send_next_command_();	//Pipeline the next command straight after the ACK rather than on the next read()
 		}
-		else
+	}
+}
+
+void ld2410::complete_command_(bool success)
+{
+	queued_command_ completed = command_queue_[command_queue_head_];
+	command_queue_head_ = (command_queue_head_ + 1) % LD2410_COMMAND_QUEUE_LENGTH;
+	command_queue_length_--;
+	waiting_for_ack_ = false;
+	if(success == false && completed.command == 0xFF)
+	{
+		configuration_failed_ = true;
+	}
+	if(success == true)
+	{
+		update_cached_configuration_(completed);
+	}
+	if(completed.batched == true)
+	{
+		if(completed.command == 0xFE)	//The commit reports on the whole batch
 		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
+			success = success && batch_failures_ == 0;
+			batch_failures_ = 0;
+		}
+		else if(success == false)
+		{
+			batch_failures_++;
 		}
 	}
-	else if(intra_frame_data_length_ == 28 && latest_ack_ == 0x61)
+	if(completed.callback != nullptr)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
+		completed.callback(*this, completed.handle, completed.command, success, completed.context);
+	}
+}
+
+uint8_t ld2410::submit_configuration_command_(uint8_t command, const uint8_t *value, uint8_t valueLength, ld2410_command_callback callback, void *context)
+{
+	uint8_t handle = 0;
+	lock_();	//The radar task mustn't start on the enter until the leave is queued too
+	if(configuration_batch_open_ == true)
+	{
+		if(command_queue_length_ + 2 <= LD2410_COMMAND_QUEUE_LENGTH)	//Always leave room for the commit
 		{
-			debug_uart_->print(F("\nACK for current configuration: "));
+			handle = submitCommand(command, value, valueLength, callback, context);
+			mark_batched_(handle);
 		}
-		#endif
-		if(latest_command_success_)
+	}
+	else if(command_queue_length_ + 3 <= LD2410_COMMAND_QUEUE_LENGTH)
+	{
+		const uint8_t enter_value_[2] = {0x01, 0x00};
+		submitCommand(0xFF, enter_value_, sizeof(enter_value_));	//Enter configuration mode
+		handle = submitCommand(command, value, valueLength, callback, context);
+		uint8_t leave_ = submitCommand(0xFE);	//Leave configuration mode
+		if(callback == blocking_command_callback_)
 		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			max_gate = radar_data_frame_[11];
-			max_moving_gate = radar_data_frame_[12];
-			max_stationary_gate = radar_data_frame_[13];
-			motion_sensitivity[0] = radar_data_frame_[14];
-			motion_sensitivity[1] = radar_data_frame_[15];
-			motion_sensitivity[2] = radar_data_frame_[16];
-			motion_sensitivity[3] = radar_data_frame_[17];
-			motion_sensitivity[4] = radar_data_frame_[18];
-			motion_sensitivity[5] = radar_data_frame_[19];
-			motion_sensitivity[6] = radar_data_frame_[20];
-			motion_sensitivity[7] = radar_data_frame_[21];
-			motion_sensitivity[8] = radar_data_frame_[22];
-			stationary_sensitivity[0] = radar_data_frame_[23];
-			stationary_sensitivity[1] = radar_data_frame_[24];
-			stationary_sensitivity[2] = radar_data_frame_[25];
-			stationary_sensitivity[3] = radar_data_frame_[26];
-			stationary_sensitivity[4] = radar_data_frame_[27];
-			stationary_sensitivity[5] = radar_data_frame_[28];
-			stationary_sensitivity[6] = radar_data_frame_[29];
-			stationary_sensitivity[7] = radar_data_frame_[30];
-			stationary_sensitivity[8] = radar_data_frame_[31];
-			sensor_idle_time = radar_data_frame_[32];
-			sensor_idle_time += (radar_data_frame_[33] << 8);
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("\nMax gate distance: "));
-				debug_uart_->print(max_gate);
-				debug_uart_->print(F("\nMax motion detecting gate distance: "));
-				debug_uart_->print(max_moving_gate);
-				debug_uart_->print(F("\nMax stationary detecting gate distance: "));
-				debug_uart_->print(max_stationary_gate);
-				debug_uart_->print(F("\nSensitivity per gate"));
-				for(uint8_t i = 0; i < 9; i++)
-				{
-					debug_uart_->print(F("\nGate "));
-					debug_uart_->print(i);
-					debug_uart_->print(F(" ("));
-					debug_uart_->print(i * 0.75);
-					debug_uart_->print('-');
-					debug_uart_->print((i+1) * 0.75);
-					debug_uart_->print(F(" metres) Motion: "));
-					debug_uart_->print(motion_sensitivity[i]);
-					debug_uart_->print(F(" Stationary: "));
-					debug_uart_->print(stationary_sensitivity[i]);
-
-				}
-				debug_uart_->print(F("\nSensor idle timeout: "));
-				debug_uart_->print(sensor_idle_time);
-				debug_uart_->print('s');
-			}
-			#endif
-			return true;
+			blocking_leave_handle_ = leave_;	//Blocking calls only come from the sketch, never the radar task
 		}
-		else
+	}
+	unlock_();
+	return handle;
+}
+
+void ld2410::mark_batched_(uint8_t handle)
+{
+	if(handle != 0)
+	{
+		command_queue_[(command_queue_head_ + command_queue_length_ - 1) % LD2410_COMMAND_QUEUE_LENGTH].batched = true;
+	}
+}
+
+bool ld2410::beginConfiguration()
+{
+	lock_();
+	if(configuration_batch_open_ == true || command_queue_length_ + 2 > LD2410_COMMAND_QUEUE_LENGTH)
+	{
+		unlock_();
+		return false;
+	}
+	const uint8_t enter_value_[2] = {0x01, 0x00};
+	mark_batched_(submitCommand(0xFF, enter_value_, sizeof(enter_value_)));	//Enter configuration mode once for the whole batch
+	configuration_batch_open_ = true;
+	unlock_();
+	return true;
+}
+
+uint8_t ld2410::commitConfigurationAsync(ld2410_command_callback callback, void *context)
+{
+	lock_();
+	if(configuration_batch_open_ == false)
+	{
+		unlock_();
+		return 0;
+	}
+	configuration_batch_open_ = false;
+	uint8_t handle = submitCommand(0xFE, nullptr, 0, callback, context);	//Space for this was reserved by every batched command
+	mark_batched_(handle);
+	unlock_();
+	return handle;
+}
+
+bool ld2410::commitConfiguration()
+{
+	bool success = false;
+	return wait_for_command_(commitConfigurationAsync(blocking_command_callback_, &success), success);
+}
+
+bool ld2410::configurationBatchOpen()
+{
+	return configuration_batch_open_;
+}
+
+void ld2410::blocking_command_callback_(ld2410 &radar, uint8_t handle, uint8_t command, bool success, void *context)
+{
+	(void)radar;
+	(void)handle;
+	(void)command;
+	*(bool *)context = success;
+}
+
+bool ld2410::wait_for_command_(uint8_t handle, bool &success)
+{
+	uint8_t leave_ = blocking_leave_handle_;
+	blocking_leave_handle_ = 0;
+	if(handle == 0)
+	{
+		return false;
+	}
+	if(configuration_batch_open_ == true)	//Inside a batch the command is only queued, commitConfiguration() reports the outcome
+	{
+		return true;
+	}
+	while(commandPending(handle) == true || (leave_ != 0 && commandPending(leave_) == true))	//Just this command and the leave after it, so later async commands don't hold it up. Data frames are parsed meanwhile
+	{
+		#if defined(ESP32)
+		if(radar_task_running_())	//The radar task sends it and handles the ACK, don't hold it up
 		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
+			delay(1);
+			continue;
 		}
+		#endif
+		read();
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0x64)
+	return success;
+}
+
+uint8_t ld2410::requestStartEngineeringModeAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0x62, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestStartEngineeringMode()
+{
+	bool success = false;
+	return wait_for_command_(requestStartEngineeringModeAsync(blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::requestEndEngineeringModeAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0x63, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestEndEngineeringMode()
+{
+	bool success = false;
+	return wait_for_command_(requestEndEngineeringModeAsync(blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::requestCurrentConfigurationAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0x61, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestCurrentConfiguration()
+{
+	bool success = false;
+	return wait_for_command_(requestCurrentConfigurationAsync(blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::requestFirmwareVersionAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0xA0, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestFirmwareVersion()
+{
+	bool success = false;
+	return wait_for_command_(requestFirmwareVersionAsync(blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::requestRestartAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0xA3, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestRestart()
+{
+	bool success = false;
+	return wait_for_command_(requestRestartAsync(blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::requestFactoryResetAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0xA2, nullptr, 0, callback, context);
+}
+
+bool ld2410::requestFactoryReset()
+{
+	bool success = false;
+	return wait_for_command_(requestFactoryResetAsync(blocking_command_callback_, &success), success);
+}
+uint8_t ld2410::requestMacAddressAsync(ld2410_command_callback callback, void *context)
+{
+	const uint8_t value_[2] = {0x01, 0x00};
+	return submit_configuration_command_(0xA5, value_, sizeof(value_), callback, context);
+}
+bool ld2410::requestMacAddress()
+{
+	bool success = false;
+	return wait_for_command_(requestMacAddressAsync(blocking_command_callback_, &success), success);
+}
+uint8_t ld2410::setBluetoothAsync(bool enabled, ld2410_command_callback callback, void *context)
+{
+	const uint8_t value_[2] = {(uint8_t)(enabled ? 0x01 : 0x00), 0x00};
+	return submit_configuration_command_(0xA4, value_, sizeof(value_), callback, context);
+}
+bool ld2410::setBluetooth(bool enabled)
+{
+	bool success = false;
+	return wait_for_command_(setBluetoothAsync(enabled, blocking_command_callback_, &success), success);
+}
+uint8_t ld2410::requestDistanceResolutionAsync(ld2410_command_callback callback, void *context)
+{
+	return submit_configuration_command_(0xAB, nullptr, 0, callback, context);
+}
+bool ld2410::requestDistanceResolution()
+{
+	bool success = false;
+	return wait_for_command_(requestDistanceResolutionAsync(blocking_command_callback_, &success), success);
+}
+uint8_t ld2410::setDistanceResolutionAsync(uint8_t resolution, ld2410_command_callback callback, void *context)
+{
+	const uint8_t value_[2] = {resolution, 0x00};
+	return submit_configuration_command_(0xAA, value_, sizeof(value_), callback, context);
+}
+bool ld2410::setDistanceResolution(uint8_t resolution)
+{
+	bool success = false;
+	return wait_for_command_(setDistanceResolutionAsync(resolution, blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::setMaxValuesAsync(uint16_t moving, uint16_t stationary, uint16_t inactivityTimer, ld2410_command_callback callback, void *context)
+{
+	const uint8_t value_[18] = {
+		0x00, 0x00,	//Moving gate command
+		(uint8_t)(moving & 0x00FF), (uint8_t)((moving & 0xFF00)>>8), 0x00, 0x00,	//Moving gate value
+		0x01, 0x00,	//Stationary gate command
+		(uint8_t)(stationary & 0x00FF), (uint8_t)((stationary & 0xFF00)>>8), 0x00, 0x00,	//Stationary gate value
+		0x02, 0x00,	//Inactivity timer command
+		(uint8_t)(inactivityTimer & 0x00FF), (uint8_t)((inactivityTimer & 0xFF00)>>8), 0x00, 0x00	//Inactivity timer
+	};
+	return submit_configuration_command_(0x60, value_, sizeof(value_), callback, context);
+}
+
+bool ld2410::setMaxValues(uint16_t moving, uint16_t stationary, uint16_t inactivityTimer)
+{
+	bool success = false;
+	return wait_for_command_(setMaxValuesAsync(moving, stationary, inactivityTimer, blocking_command_callback_, &success), success);
+}
+
+uint8_t ld2410::setGateSensitivityThresholdAsync(uint8_t gate, uint8_t moving, uint8_t stationary, ld2410_command_callback callback, void *context)
+{
+	uint8_t gate_low_ = gate;
+	uint8_t gate_high_ = 0x00;
+	if(gate == LD2410_ALL_GATES)
+	{
+		gate_low_ = 0xFF;		//Gate 0xFFFF sets every gate at once
+		gate_high_ = 0xFF;
+	}
+	const uint8_t value_[18] = {
+		0x00, 0x00,	//Gate command
+		gate_low_, gate_high_, 0x00, 0x00,	//Gate value
+		0x01, 0x00,	//Motion sensitivity command
+		moving, 0x00, 0x00, 0x00,	//Motion sensitivity value
+		0x02, 0x00,	//Stationary sensitivity command
+		stationary, 0x00, 0x00, 0x00	//Stationary sensitivity value
+	};
+	return submit_configuration_command_(0x64, value_, sizeof(value_), callback, context);
+}
+
+bool ld2410::setGateSensitivityThreshold(uint8_t gate, uint8_t moving, uint8_t stationary)
+{
+	bool success = false;
+	return wait_for_command_(setGateSensitivityThresholdAsync(gate, moving, stationary, blocking_command_callback_, &success), success);
+}
+
+bool ld2410::setSensitivityProfile(const uint8_t moving[9], const uint8_t stationary[9])
+{
+	uint8_t changed_gates_ = 0;
+	for(uint8_t i = 0; i < 9; i++)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nACK for setting sensitivity values: "));
-		}
-		#endif
-		if(latest_command_success_)
-		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
-		}
-		else
+		if(configuration_valid_ == false || moving[i] != motion_sensitivity[i] || stationary[i] != stationary_sensitivity[i])
 		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
+			changed_gates_++;
 		}
 	}
-	else if(intra_frame_data_length_ == 12 && latest_ack_ == 0xA0)
+	if(changed_gates_ == 0)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nACK for firmware version: "));
-		}
-		#endif
-		if(latest_command_success_)
-		{
-			firmware_major_version = radar_data_frame_[13];
-			firmware_minor_version = radar_data_frame_[12];
-			firmware_bugfix_version = radar_data_frame_[14];
-			firmware_bugfix_version += radar_data_frame_[15]<<8;
-			firmware_bugfix_version += radar_data_frame_[16]<<16;
-			firmware_bugfix_version += radar_data_frame_[17]<<24;
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
-		}
-		else
-		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
-		}
+		return true;	//The radar already has this profile
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0xA2)
+	bool own_batch_ = (configuration_batch_open_ == false);
+	if(own_batch_ == true && beginConfiguration() == false)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nACK for factory reset: "));
-		}
-		#endif
-		if(latest_command_success_)
-		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
-		}
-		else
-		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
-		}
+		return false;
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0xA3)
+	bool queued_ = queue_sensitivity_profile_(moving, stationary);
+	if(own_batch_ == true)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nACK for restart: "));
-		}
-		#endif
-		if(latest_command_success_)
-		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
-		}
-		else
-		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
-		}
+		return commitConfiguration() && queued_;
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0x62)
+	return queued_;
+}
+
+bool ld2410::queue_sensitivity_profile_(const uint8_t *moving, const uint8_t *stationary)
+{
+	uint8_t common_gate_ = 0;	//Gate whose pair of values is shared by the most gates, the candidate for a broadcast
+	uint8_t common_count_ = 0;
+	uint8_t changed_gates_ = 0;
+	for(uint8_t i = 0; i < 9; i++)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nACK for enable engineering mode: "));
-		}
-		#endif
-		if(latest_command_success_)
+		uint8_t count_ = 0;
+		for(uint8_t j = 0; j < 9; j++)
 		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
+			if(moving[j] == moving[i] && stationary[j] == stationary[i])
 			{
-				debug_uart_->print(F("OK"));
+				count_++;
 			}
-			#endif
-			return true;
 		}
-		else
+		if(count_ > common_count_)
 		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
+			common_count_ = count_;
+			common_gate_ = i;
+		}
+		if(configuration_valid_ == false || moving[i] != motion_sensitivity[i] || stationary[i] != stationary_sensitivity[i])
+		{
+			changed_gates_++;
 		}
 	}
-	else if(intra_frame_data_length_ == 4 && latest_ack_ == 0x63)
+	bool broadcast_ = (1 + 9 - common_count_) < changed_gates_;	//One broadcast plus the gates that differ from it, against one command per changed gate
+	bool queued_ = true;
+	if(broadcast_ == true)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
+		queued_ = setGateSensitivityThresholdAsync(LD2410_ALL_GATES, moving[common_gate_], stationary[common_gate_]) != 0;
+	}
+	for(uint8_t i = 0; i < 9 && queued_ == true; i++)
+	{
+		bool needed_;
+		if(broadcast_ == true)
 		{
-			debug_uart_->print(F("\nACK for disable engineering mode: "));
+			needed_ = moving[i] != moving[common_gate_] || stationary[i] != stationary[common_gate_];
 		}
-		#endif
-		if(latest_command_success_)
+		else
 		{
-			radar_uart_last_packet_ = millis();
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("OK"));
-			}
-			#endif
-			return true;
+			needed_ = configuration_valid_ == false || moving[i] != motion_sensitivity[i] || stationary[i] != stationary_sensitivity[i];
 		}
-		else
+		if(needed_ == true)
 		{
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("failed"));
-			}
-			return false;
+			queued_ = setGateSensitivityThresholdAsync(i, moving[i], stationary[i]) != 0;
 		}
 	}
-	else
+	return queued_;
+}
+
+bool ld2410::startCalibration(uint32_t durationMs, uint8_t sigmaTenths, ld2410_calibration_callback callback, void *context)
+{
+	lock_();
+	if(calibration_recording_ == true || calibration_applying_ == true)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
-		{
-			debug_uart_->print(F("\nUnknown ACK"));
-		}
-		#endif
+		unlock_();
+		return false;
 	}
-	return false;
+	ld2410_report report_;
+	calibration_end_engineering_ = (latestReport(report_) == false || report_.engineering == false);
+	if(calibration_end_engineering_ == true && requestStartEngineeringModeAsync() == 0)	//Gate energies only come in engineering frames
+	{
+		unlock_();
+		return false;
+	}
+	calibration_statistics_.reset();
+	calibration_started_ = millis();
+	calibration_duration_ = durationMs;
+	calibration_sigma_ = sigmaTenths;
+	calibration_callback_ = callback;
+	calibration_context_ = context;
+	calibration_recording_ = true;
+	unlock_();
+	return true;
+}
+
+bool ld2410::calibrating()
+{
+	return calibration_recording_ || calibration_applying_;
 }
 
-void ld2410::send_command_preamble_()
+void ld2410::setAdaptiveEngineeringMode(bool enabled, uint32_t holdMs)
 {
-	//Command preamble
-	radar_uart_->write((byte)0xFD);
-	radar_uart_->write((byte)0xFC);
-	radar_uart_->write((byte)0xFB);
-	radar_uart_->write((byte)0xFA);
+	lock_();
+	if(enabled == true && adaptive_enabled_ == false)
+	{
+		ld2410_report report_;
+		adaptive_engineering_ = latestReport(report_) && report_.engineering;	//Start from the mode the radar is in
+		adaptive_idle_ = false;
+		adaptive_retry_wait_ = false;
+	}
+	adaptive_enabled_ = enabled;
+	adaptive_hold_ = holdMs;
+	unlock_();
 }
 
-void ld2410::send_command_postamble_()
+bool ld2410::adaptiveEngineeringMode()
 {
-	//Command end
-	radar_uart_->write((byte)0x04);
-	radar_uart_->write((byte)0x03);
-	radar_uart_->write((byte)0x02);
-	radar_uart_->write((byte)0x01);
+	return adaptive_enabled_;
 }
 
-bool ld2410::enter_configuration_mode_()
+void ld2410::process_adaptive_engineering_()
 {
-	send_command_preamble_();
-	//Request firmware
-	radar_uart_->write((byte) 0x04);	//Command is four bytes long
-	radar_uart_->write((byte) 0x00);
-	radar_uart_->write((byte) 0xFF);	//Request enter command mode
-	radar_uart_->write((byte) 0x00);
-	radar_uart_->write((byte) 0x01);
-	radar_uart_->write((byte) 0x00);
-	send_command_postamble_();
-	radar_uart_last_command_ = millis();
-	while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
+	if(adaptive_enabled_ == false || adaptive_handle_ != 0 || calibrating() == true)
+	{
+		return;
+	}
+	bool wanted_ = true;
+	if(presence_ == true)
+	{
+		adaptive_idle_ = false;
+	}
+	else
 	{
-		if(read_frame_())
+		if(adaptive_idle_ == false)
 		{
-			if(latest_ack_ == 0xFF && latest_command_success_)
-			{
-				return true;
-			}
+			adaptive_idle_ = true;
+			adaptive_idle_since_ = millis();
 		}
+		wanted_ = adaptive_engineering_ == true && millis() - adaptive_idle_since_ < adaptive_hold_;
 	}
-	return false;
+	if(wanted_ == adaptive_engineering_ || (adaptive_retry_wait_ == true && millis() - adaptive_last_attempt_ < LD2410_ADAPTIVE_RETRY_INTERVAL))
+	{
+		return;
+	}
+	if(configuration_batch_open_ == true)
+	{
+		return;	//It would join the sketch's batch and only happen at its commit, so wait for the batch to close
+	}
+	adaptive_last_attempt_ = millis();
+	adaptive_target_ = wanted_;
+	adaptive_handle_ = wanted_ ? requestStartEngineeringModeAsync(adaptive_command_callback_, this) : requestEndEngineeringModeAsync(adaptive_command_callback_, this);	//Frames keep being parsed while it is in flight
+	adaptive_retry_wait_ = (adaptive_handle_ == 0);	//The queue is full, try again later
 }
 
-bool ld2410::leave_configuration_mode_()
+void ld2410::adaptive_command_callback_(ld2410 &radar, uint8_t handle, uint8_t command, bool success, void *context)
 {
-	send_command_preamble_();
-	//Request firmware
-	radar_uart_->write((byte) 0x02);	//Command is two bytes long
-	radar_uart_->write((byte) 0x00);
-	radar_uart_->write((byte) 0xFE);	//Request leave command mode
-	radar_uart_->write((byte) 0x00);
-	send_command_postamble_();
-	radar_uart_last_command_ = millis();
-	while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
+	(void)handle;
+	(void)command;
+	(void)context;
+	radar.adaptive_handle_ = 0;
+	radar.adaptive_retry_wait_ = (success == false);
+	if(success == true)
+	{
+		radar.adaptive_engineering_ = radar.adaptive_target_;
+	}
+}
+
+void ld2410::cancelCalibration()
+{
+	lock_();
+	if(calibration_recording_ == true)
 	{
-		if(read_frame_())
+		calibration_recording_ = false;
+		if(calibration_end_engineering_ == true)
 		{
-			if(latest_ack_ == 0xFE && latest_command_success_)
-			{
-				return true;
-			}
+			requestEndEngineeringModeAsync();
 		}
 	}
-	return false;
+	unlock_();
 }
 
-bool ld2410::requestStartEngineeringMode()
+void ld2410::process_calibration_()
 {
-	// Must enter configuration mode first!
-	if(!enter_configuration_mode_())
+	if(calibration_recording_ == false || millis() - calibration_started_ < calibration_duration_)
 	{
-		#ifdef LD2410_DEBUG_COMMANDS
-		if(debug_uart_ != nullptr)
+		return;
+	}
+	if(calibration_statistics_.frames() == 0)	//Not one engineering frame in a whole window
+	{
+		calibration_recording_ = false;
+		if(calibration_end_engineering_ == true)
 		{
-			debug_uart_->println(F("Failed to enter config mode for engineering"));
+			requestEndEngineeringModeAsync();
 		}
-		#endif
-		return false;
+		finish_calibration_(false);
+		return;
 	}
-	
-	delay(50);  // Small delay after entering config mode
-	
-	send_command_preamble_();
-	//Request enable engineering mode
-	radar_uart_->write((byte) 0x02);	//Command is two bytes long
-	radar_uart_->write((byte) 0x00);
-	radar_uart_->write((byte) 0x62);	//Enable engineering mode
-	radar_uart_->write((byte) 0x00);
-	send_command_postamble_();
-	radar_uart_last_command_ = millis();
-	
-	bool success = false;
-	while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
+	if(beginConfiguration() == false)
+	{
+		return;	//Another batch is open or the queue is full, try again on the next pass
+	}
+	calibration_recording_ = false;
+	uint8_t moving_[9];
+	uint8_t stationary_[9];
+	for(uint8_t i = 0; i < 9; i++)
+	{
+		moving_[i] = calibration_threshold_(i);
+		stationary_[i] = calibration_threshold_(9 + i);
+	}
+	bool queued_ = queue_sensitivity_profile_(moving_, stationary_);
+	if(calibration_end_engineering_ == true && requestEndEngineeringModeAsync() == 0)	//Joins the batch, so it needs no configuration mode of its own
+	{
+		queued_ = false;	//The radar would be left in engineering mode
+	}
+	#ifdef LD2410_DEBUG_COMMANDS
+	if(debug_uart_ != nullptr)
 	{
-		if(read_frame_())
+		debug_uart_->print(F("\nCalibrated over "));
+		debug_uart_->print(calibration_statistics_.frames());
+		debug_uart_->print(F(" frames, moving/stationary thresholds:"));
+		for(uint8_t i = 0; i < 9; i++)
 		{
-			#ifdef LD2410_DEBUG_COMMANDS
-			if(debug_uart_ != nullptr)
-			{
-				debug_uart_->print(F("Engineering ACK: 0x"));
-				debug_uart_->print(latest_ack_, HEX);
-				debug_uart_->print(F(" Success: "));
-				debug_uart_->println(latest_command_success_);
-			}
-			#endif
-			
-			if(latest_ack_ == 0x62 && latest_command_success_)
-			{
-				success = true;
-				break;
-			}
+			debug_uart_->print(' ');
+			debug_uart_->print(moving_[i]);
+			debug_uart_->print('/');
+			debug_uart_->print(stationary_[i]);
 		}
 	}
-	
-	delay(50);  // Small delay before leaving config mode
-	
-	// Leave configuration mode
-	leave_configuration_mode_();
-	
-	return success;
+	#endif
+	calibration_applying_ = true;
+	commitConfigurationAsync(calibration_commit_callback_, queued_ ? this : nullptr);	//Always has room, beginConfiguration() reserved it
 }
 
-bool ld2410::requestEndEngineeringMode()
+uint8_t ld2410::calibration_threshold_(uint8_t gate)
 {
-	send_command_preamble_();
-	//Request firmware
-	radar_uart_->write((byte) 0x02);	//Command is two bytes long
-	radar_uart_->write((byte) 0x00);
-	radar_uart_->write((byte) 0x63);	//Request leave command mode
-	radar_uart_->write((byte) 0x00);
-	send_command_postamble_();
-	radar_uart_last_command_ = millis();
-	while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
+	uint32_t variance_ = calibration_statistics_.variance(gate);
+	uint32_t deviation_ = 0;	//Integer square root of the variance
+	for(uint32_t bit_ = 1UL << 15; bit_ > 0; bit_ >>= 1)
 	{
-		if(read_frame_())
+		if((deviation_ + bit_) * (deviation_ + bit_) <= variance_)
 		{
-			if(latest_ack_ == 0x63 && latest_command_success_)
-			{
-				return true;
-			}
+			deviation_ += bit_;
 		}
 	}
-	return false;
+	if(variance_ > deviation_ * deviation_ + deviation_)
+	{
+		deviation_++;	//Round to nearest, (d + 0.5)^2 lies between d^2 + d and d^2 + d + 1
+	}
+	uint32_t threshold_ = calibration_statistics_.mean(gate) + (deviation_ * calibration_sigma_ + 9) / 10;	//Rounded up, a threshold right on the noise would trigger on it
+	if(threshold_ < LD2410_CALIBRATION_MIN_THRESHOLD)
+	{
+		threshold_ = LD2410_CALIBRATION_MIN_THRESHOLD;
+	}
+	if(threshold_ > 100)
+	{
+		threshold_ = 100;
+	}
+	return threshold_;
 }
 
-bool ld2410::requestCurrentConfiguration()
+void ld2410::finish_calibration_(bool success)
 {
-	if(enter_configuration_mode_())
+	calibration_applying_ = false;
+	if(calibration_callback_ != nullptr)
 	{
-		delay(50);
-		send_command_preamble_();
-		//Request firmware
-		radar_uart_->write((byte) 0x02);	//Command is two bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x61);	//Request current configuration
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			if(read_frame_())
-			{
-				if(latest_ack_ == 0x61 && latest_command_success_)
-				{
-					delay(50);
-					leave_configuration_mode_();
-					return true;
-				}
-			}
-		}
+		calibration_callback_(*this, success, calibration_context_);
 	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
 }
 
-bool ld2410::requestFirmwareVersion()
+void ld2410::calibration_commit_callback_(ld2410 &radar, uint8_t handle, uint8_t command, bool success, void *context)
 {
-	if(enter_configuration_mode_())
-	{
-		delay(50);
-		send_command_preamble_();
-		//Request firmware
-		radar_uart_->write((byte) 0x02);	//Command is two bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0xA0);	//Request firmware version
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			read_frame_();
-			if(latest_ack_ == 0xA0 && latest_command_success_)
-			{
-				delay(50);
-				leave_configuration_mode_();
-				return true;
-			}
-		}
-	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
+	(void)handle;
+	(void)command;
+	radar.finish_calibration_(success && context != nullptr);	//No context means some thresholds, or leaving engineering mode, didn't fit in the queue
 }
 
-bool ld2410::requestRestart()
+bool ld2410::getConfiguration(ld2410_configuration &configuration)
 {
-	if(enter_configuration_mode_())
+	lock_();	//ACKs update these from the radar task
+	configuration.firmware_major_version = firmware_major_version;
+	configuration.firmware_minor_version = firmware_minor_version;
+	configuration.firmware_bugfix_version = firmware_bugfix_version;
+	configuration.max_gate = max_gate;
+	configuration.max_moving_gate = max_moving_gate;
+	configuration.max_stationary_gate = max_stationary_gate;
+	configuration.sensor_idle_time = sensor_idle_time;
+	for(uint8_t i = 0; i < 9; i++)
 	{
-		delay(50);
-		send_command_preamble_();
-		//Request firmware
-		radar_uart_->write((byte) 0x02);	//Command is two bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0xA3);	//Request restart
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			if(read_frame_())
-			{
-				if(latest_ack_ == 0xA3 && latest_command_success_)
-				{
-					delay(50);
-					leave_configuration_mode_();
-					return true;
-				}
-			}
-		}
+		configuration.motion_sensitivity[i] = motion_sensitivity[i];
+		configuration.stationary_sensitivity[i] = stationary_sensitivity[i];
 	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
+	bool valid_ = configuration_valid_;
+	unlock_();
+	return valid_;
 }
 
-bool ld2410::requestFactoryReset()
+void ld2410::restoreConfiguration(const ld2410_configuration &configuration)
 {
-	if(enter_configuration_mode_())
+	lock_();
+	firmware_major_version = configuration.firmware_major_version;
+	firmware_minor_version = configuration.firmware_minor_version;
+	firmware_bugfix_version = configuration.firmware_bugfix_version;
+	max_gate = configuration.max_gate;
+	max_moving_gate = configuration.max_moving_gate;
+	max_stationary_gate = configuration.max_stationary_gate;
+	sensor_idle_time = configuration.sensor_idle_time;
+	for(uint8_t i = 0; i < 9; i++)
 	{
-		delay(50);
-		send_command_preamble_();
-		//Request firmware
-		radar_uart_->write((byte) 0x02);	//Command is two bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0xA2);	//Request factory reset
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			if(read_frame_())
-			{
-				if(latest_ack_ == 0xA2 && latest_command_success_)
-				{
-					delay(50);
-					leave_configuration_mode_();
-					return true;
-				}
-			}
-		}
+		motion_sensitivity[i] = configuration.motion_sensitivity[i];
+		stationary_sensitivity[i] = configuration.stationary_sensitivity[i];
 	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
+	configuration_valid_ = true;	//So setSensitivityProfile() only sends what differs from it
+	unlock_();
 }
 
-bool ld2410::setMaxValues(uint16_t moving, uint16_t stationary, uint16_t inactivityTimer)
+void ld2410::update_cached_configuration_(const queued_command_ &command)
 {
-	if(enter_configuration_mode_())
-	{
-		delay(50);
-		send_command_preamble_();
-		radar_uart_->write((byte) 0x14);	//Command is 20 bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x60);	//Request set max values
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x00);	//Moving gate command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(moving & 0x00FF));	//Moving gate value
-		radar_uart_->write(char((moving & 0xFF00)>>8));
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x01);	//Stationary gate command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(stationary & 0x00FF));	//Stationary gate value
-		radar_uart_->write(char((stationary & 0xFF00)>>8));
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x02);	//Inactivity timer command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(inactivityTimer & 0x00FF));	//Inactivity timer
-		radar_uart_->write(char((inactivityTimer & 0xFF00)>>8));
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			if(read_frame_())
-			{
-				if(latest_ack_ == 0x60 && latest_command_success_)
-				{
-					delay(50);
-					leave_configuration_mode_();
-					return true;
-				}
-			}
-		}
+	const uint8_t *value_ = command.frame + LD2410_COMMAND_VALUE_OFFSET;
+	if(command.command == 0x61)
+	{
+		configuration_valid_ = true;
 	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
-}
-
-bool ld2410::setGateSensitivityThreshold(uint8_t gate, uint8_t moving, uint8_t stationary)
-{
-	if(enter_configuration_mode_())
-	{
-		delay(50);
-		send_command_preamble_();
-		radar_uart_->write((byte) 0x14);	//Command is 20 bytes long
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x64);	//Request set sensitivity values
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x00);	//Gate command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(gate));	//Gate value
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x01);	//Motion sensitivity command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(moving));	//Motion sensitivity value
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x02);	//Stationary sensitivity command
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write(char(stationary));	//Stationary sensitivity value
-		radar_uart_->write((byte) 0x00);
-		radar_uart_->write((byte) 0x00);	//Spacer
-		radar_uart_->write((byte) 0x00);
-		send_command_postamble_();
-		radar_uart_last_command_ = millis();
-		while(millis() - radar_uart_last_command_ < radar_uart_command_timeout_)
-		{
-			if(read_frame_())
+	else if(command.command == 0x60)	//Max values, as ACKed by the radar
+	{
+		max_moving_gate = value_[2];
+		max_stationary_gate = value_[8];
+		sensor_idle_time = value_[14] + (value_[15] << 8);
+	}
+	else if(command.command == 0x64)	//Gate sensitivity, as ACKed by the radar
+	{
+		if(value_[2] == 0xFF && value_[3] == 0xFF)
+		{
+			for(uint8_t i = 0; i < 9; i++)
 			{
-				if(latest_ack_ == 0x64 && latest_command_success_)
-				{
-					delay(50);
-					leave_configuration_mode_();
-					return true;
-				}
+				motion_sensitivity[i] = value_[8];
+				stationary_sensitivity[i] = value_[14];
 			}
 		}
+		else if(value_[2] < 9)
+		{
+			motion_sensitivity[value_[2]] = value_[8];
+			stationary_sensitivity[value_[2]] = value_[14];
+		}
+	}
+	else if(command.command == 0xAA)	//Distance resolution, as ACKed by the radar
+	{
+		distance_resolution = value_[0];
+	}
+	else if(command.command == 0xA2)	//Factory reset, the cache no longer reflects the radar
+	{
+		configuration_valid_ = false;
 	}
-	delay(50);
-	leave_configuration_mode_();
-	return false;
 }
 #endif
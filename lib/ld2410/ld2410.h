@@ -13,11 +13,159 @@
 #ifndef ld2410_h
 #define ld2410_h
 #include <Arduino.h>
+#include <stddef.h>
+#include "ld2410_ring_buffer.h"
+#include "ld2410_gate_statistics.h"
 
 #define LD2410_MAX_FRAME_LENGTH 50
+#define LD2410_UART_BUFFER_SIZE 64										//Scratch buffer used to drain the UART in blocks
+#define LD2410_RX_RING_SIZE 512											//Bytes buffered between the UART receive callback and read(), must be a power of two
+#define LD2410_HISTORY_LENGTH 16										//Data frames kept for popReport()/historyReport(), one fewer can be read as the next is written over the oldest. Must be a power of two
+#define LD2410_COMMAND_QUEUE_LENGTH 16									//Commands that can be waiting to go to the radar at once
+#define LD2410_MAX_COMMAND_VALUE_LENGTH 18								//Longest command value, after the command word
+#define LD2410_COMMAND_VALUE_OFFSET 8									//Header, length and command word come before the value in a command frame
+#define LD2410_MAX_COMMAND_FRAME_LENGTH (LD2410_COMMAND_VALUE_OFFSET + LD2410_MAX_COMMAND_VALUE_LENGTH + 4)	//Then the tail
+#define LD2410_ALL_GATES 0xFF											//Gate number that sets the sensitivity of every gate in one command
+#define LD2410_RESTART_TIMEOUT 2000										//How long to wait for the radar to answer after a restart
+#define LD2410_BAUD_PROBE_TIME 250										//How long to listen at each baud rate when searching for the radar
+#define LD2410_DISTANCE_RESOLUTION_75CM 0x00							//setDistanceResolution() gate sizes
+#define LD2410_DISTANCE_RESOLUTION_20CM 0x01
+#define LD2410_OPTION_RECEIVE_EVENTS 0x01								//begin() option: queue bytes from the UART receive callback instead of polling the Stream
+#define LD2410_OPTION_AUTO_BAUD 0x02									//begin() option: if the radar doesn't answer, search the baud rates it supports
+#define LD2410_OPTION_RADAR_TASK 0x04									//begin() option: parse frames and send commands from a dedicated FreeRTOS task, see read()
+#define LD2410_TASK_STACK_SIZE 4096										//Bytes of stack for the radar task
+#define LD2410_TASK_PRIORITY 5											//Above the Arduino loop() task so radar timing doesn't depend on application work
+#define LD2410_TASK_CORE 0												//Core the radar task is pinned to
+#define LD2410_TASK_POLL_INTERVAL 10									//The radar task wakes at least this often (ms) to time out commands
+#define LD2410_CONNECTION_TIMEOUT 1000									//No frame for this long (ms) runs the onConnectionLost() callback
+#define LD2410_CALIBRATION_TIME 10000									//Default length (ms) of the empty room window for startCalibration()
+#define LD2410_CALIBRATION_SIGMA 30										//Default margin above the noise floor, in tenths of a standard deviation
+#define LD2410_CALIBRATION_MIN_THRESHOLD 10								//No calibrated threshold is set below this, however quiet the gate
+#define LD2410_ADAPTIVE_HOLD_TIME 30000									//Default time (ms) without presence before adaptive engineering mode goes back to basic frames
+#define LD2410_ADAPTIVE_RETRY_INTERVAL 1000								//Wait this long (ms) after a mode switch fails before trying again
+//Debug output is compiled in only when asked for, e.g. -DLD2410_DEBUG_COMMANDS in build_flags, as printing from the parser stalls it for as long as the debug stream takes to drain
 //#define LD2410_DEBUG_DATA
-#define LD2410_DEBUG_COMMANDS
+//#define LD2410_DEBUG_COMMANDS
 //#define LD2410_DEBUG_PARSE
+#if defined(LD2410_DEBUG_DATA) || defined(LD2410_DEBUG_COMMANDS) || defined(LD2410_DEBUG_PARSE)
+#define LD2410_DEBUG_ANY
+#endif
+//#define LD2410_TRACE														//Record parser and command events as small binary records for popTrace(), for diagnostics without the cost of printing
+#define LD2410_TRACE_LENGTH 64											//Trace events kept until popTrace(), must be a power of two
+#define LD2410_TRACE_DATA_FRAME 0x01									//Trace event types. code 1 for engineering mode, value frame length
+#define LD2410_TRACE_ACK 0x02											//code command, value 1 for success
+#define LD2410_TRACE_COMMAND_SENT 0x03									//code command, value handle
+#define LD2410_TRACE_COMMAND_TIMEOUT 0x04								//code command, value handle
+#define LD2410_TRACE_UNKNOWN_FRAME 0x05									//code frame type byte, value frame length
+#define LD2410_TRACE_FRAME_LENGTH 0x06									//No footer where the header's length puts it, code frame type byte, value expected frame length
+#define LD2410_TRACE_FRAME_OVERRUN 0x07									//Header length beyond LD2410_MAX_FRAME_LENGTH, code first header byte, value that length
+
+struct __attribute__((packed)) ld2410_target_data	{				//Target data at the same place in both kinds of data frame, little endian like the hosts this runs on
+	uint8_t target_state;												//0 none, bit 0 moving, bit 1 stationary
+	uint16_t moving_target_distance;									//cm
+	uint8_t moving_target_energy;
+	uint16_t stationary_target_distance;
+	uint8_t stationary_target_energy;
+	uint16_t detection_distance;
+};
+
+struct __attribute__((packed)) ld2410_basic_frame	{					//A whole basic data frame as received, header to footer
+	uint8_t header[4];													//F4 F3 F2 F1
+	uint16_t length;													//Bytes from type to check
+	uint8_t type;														//0x02
+	uint8_t head;														//0xAA
+	ld2410_target_data target;
+	uint8_t tail;														//0x55
+	uint8_t check;														//0x00
+	uint8_t footer[4];													//F8 F7 F6 F5
+};
+
+struct __attribute__((packed)) ld2410_engineering_frame	{				//A whole engineering mode data frame as received
+	uint8_t header[4];
+	uint16_t length;
+	uint8_t type;														//0x01
+	uint8_t head;														//0xAA
+	ld2410_target_data target;
+	uint8_t moving_max_gate;
+	uint8_t stationary_max_gate;
+	uint8_t moving_energy[9];
+	uint8_t stationary_energy[9];
+	uint8_t light_level;												//Photosensitive value, 0-255. Not sent by older firmware, the frame is then two bytes shorter
+	uint8_t out_pin;													//Level of the OUT pin
+	uint8_t tail;
+	uint8_t check;
+	uint8_t footer[4];
+};
+
+static_assert(offsetof(ld2410_basic_frame, target) == 8 && offsetof(ld2410_basic_frame, tail) == 17 && sizeof(ld2410_basic_frame) == 23, "ld2410_basic_frame must match the radar's basic data frame");
+static_assert(offsetof(ld2410_engineering_frame, target) == 8 && offsetof(ld2410_engineering_frame, moving_max_gate) == 17 && offsetof(ld2410_engineering_frame, moving_energy) == 19 && offsetof(ld2410_engineering_frame, stationary_energy) == 28 && offsetof(ld2410_engineering_frame, light_level) == 37 && offsetof(ld2410_engineering_frame, tail) == 39 && sizeof(ld2410_engineering_frame) == 45, "ld2410_engineering_frame must match the radar's engineering data frame");
+static_assert(sizeof(ld2410_engineering_frame) <= LD2410_MAX_FRAME_LENGTH, "LD2410_MAX_FRAME_LENGTH is too small for an engineering frame");
+
+struct ld2410_report	{												//Snapshot of one data frame
+	uint32_t sequence = 0;												//Increments for every data frame parsed, 0 before the first
+	uint64_t timestamp_us = 0;											//Microseconds since boot when the frame header started arriving
+	bool engineering = false;											//Gate energies below came from an engineering mode frame
+	uint8_t target_type = 0;											//0 none, bit 0 moving, bit 1 stationary
+	bool presence = false;												//Presence after setPresenceFilter() debounce, hold and hysteresis
+	uint16_t moving_target_distance = 0;
+	uint8_t moving_target_energy = 0;
+	uint16_t stationary_target_distance = 0;
+	uint8_t stationary_target_energy = 0;
+	uint16_t detection_distance = 0;
+	uint8_t moving_energy[9] = {0,0,0,0,0,0,0,0,0};
+	uint8_t stationary_energy[9] = {0,0,0,0,0,0,0,0,0};
+	uint8_t light_level = 0;											//Engineering frames from firmware that sends it, otherwise 0
+	bool out_pin = false;												//Engineering frames from firmware that sends it
+};
+
+class ld2410;
+struct ld2410_configuration	{										//What requestFirmwareVersion() and requestCurrentConfiguration() read, so it can be saved and restored without asking the radar
+	uint8_t firmware_major_version = 0;
+	uint8_t firmware_minor_version = 0;
+	uint32_t firmware_bugfix_version = 0;
+	uint8_t max_gate = 0;
+	uint8_t max_moving_gate = 0;
+	uint8_t max_stationary_gate = 0;
+	uint16_t sensor_idle_time = 0;
+	uint8_t motion_sensitivity[9] = {0,0,0,0,0,0,0,0,0};
+	uint8_t stationary_sensitivity[9] = {0,0,0,0,0,0,0,0,0};
+};
+
+struct ld2410_counters	{												//Always on parser and command counters, see getCounters()
+	uint32_t bytes_received = 0;
+	uint32_t bytes_discarded = 0;										//Outside any frame, e.g. while resynchronising
+	uint32_t receive_overflow_bytes = 0;								//Dropped by the UART receive callback because the ring buffer was full
+	uint16_t uart_high_water = 0;										//Most bytes waiting at the start of one read, against the UART or ring buffer size
+	uint32_t data_frames = 0;
+	uint32_t ack_frames = 0;
+	uint32_t unknown_frames = 0;										//Data frames of a type the parser doesn't know
+	uint32_t length_mismatches = 0;										//No footer where the header's length puts it, the bytes are scanned again for a header
+	uint32_t frame_overruns = 0;										//Header length beyond LD2410_MAX_FRAME_LENGTH
+	uint32_t commands_sent = 0;
+	uint32_t command_timeouts = 0;
+	uint32_t parse_passes = 0;											//Reads that completed a frame, the ones the parse times below cover
+	uint32_t parse_cycles_min = 0;										//CPU cycles on ESP32, microseconds elsewhere. Includes any frame callbacks
+	uint32_t parse_cycles_max = 0;
+	uint64_t parse_cycles_total = 0;									//Divide by parse_passes for the average
+};
+
+#ifdef LD2410_TRACE
+struct ld2410_trace_event	{											//One parser or command event, see LD2410_TRACE_*
+	uint32_t time_us;													//Low 32 bits of the microsecond timestamp
+	uint8_t type;
+	uint8_t code;
+	uint16_t value;
+};
+#endif
+
+typedef void (*ld2410_command_callback)(ld2410 &radar, uint8_t handle, uint8_t command, bool success, void *context);	//Called once a queued command is ACKed or times out, from the radar task with LD2410_OPTION_RADAR_TASK so it must not block
+typedef void (*ld2410_frame_callback)(ld2410 &radar, const ld2410_report &report, void *context);	//A data frame was parsed, report is only valid during the call
+typedef void (*ld2410_raw_frame_callback)(ld2410 &radar, const uint8_t *frame, uint8_t length, uint64_t timestamp_us, uint32_t sequence, void *context);	//A data frame or ACK passed its checks, header to footer. Sequence is the latest data frame's
+typedef void (*ld2410_presence_callback)(ld2410 &radar, bool present, void *context);	//Presence started or ended
+typedef void (*ld2410_ack_callback)(ld2410 &radar, uint8_t command, bool success, void *context);	//Any ACK from the radar, whether or not it was for a queued command
+typedef void (*ld2410_event_callback)(ld2410 &radar, void *context);
+typedef void (*ld2410_calibration_callback)(ld2410 &radar, bool success, void *context);	//Calibration finished, success if the thresholds were applied
+typedef uint64_t (*ld2410_clock_callback)(void *context);				//Capture time in us for the frame whose header is being read
 
 class ld2410	{
 
@@ -25,34 +173,99 @@ class ld2410	{
 		ld2410();														//Constructor function
 		~ld2410();														//Destructor function
 		bool begin(Stream &, bool waitForRadar = true);					//Start the ld2410
-		void debug(Stream &);											//Start debugging on a stream
+		#if defined(ESP32)
+		bool begin(HardwareSerial &, bool waitForRadar = true, uint8_t options = 0);	//Start the ld2410 on a hardware UART, with LD2410_OPTION_* flags
+		#endif
+		void debug(Stream &);											//Start debugging on a stream, only prints what the LD2410_DEBUG_* flags compiled in
+		#ifdef LD2410_TRACE
+		bool popTrace(ld2410_trace_event &);							//Oldest unread trace event, false if there are none
+		uint32_t traceDropped();										//Events lost because the trace buffer was full
+		#endif
 		bool isConnected();
-		bool read();
-		bool presenceDetected();
+		uint8_t read();													//Parse everything waiting on the UART, returns the number of complete frames. With LD2410_OPTION_RADAR_TASK, frames published since the last call
+		bool latestReport(ld2410_report &);								//Copy out the latest data frame, false if none has arrived yet. Never torn, even while the radar task is publishing
+		uint32_t frameSequence();										//Sequence number of the latest data frame
+		bool historyReport(ld2410_report &, uint16_t age = 0);			//Copy out a recent frame, 0 is the latest, false if it is no longer kept. Never torn, like latestReport()
+		uint16_t reportsAvailable();									//Frames not yet taken with popReport()
+		bool popReport(ld2410_report &);								//Copy out the oldest unread frame, false if there is none. Never torn, like latestReport()
+		uint32_t reportsDropped();										//Frames overwritten before popReport() got to them
+		void getCounters(ld2410_counters &);							//Copy out the parser and command counters
+		void resetCounters();
+		bool presenceDetected();										//Target accessors read the latest published frame, like latestReport(). This one is filtered, see setPresenceFilter()
+		void setPresenceFilter(uint32_t debounceMs, uint32_t holdMs, uint8_t onEnergy = 0, uint8_t offEnergy = 0);	//Present once targets of onEnergy or more last debounceMs, absent once nothing of offEnergy or more for holdMs. Defaults to all 0, the radar's own target state
 		bool stationaryTargetDetected();
 		uint16_t stationaryTargetDistance();
 		uint8_t stationaryTargetEnergy();
 		bool movingTargetDetected();
 		uint16_t movingTargetDistance();
 		uint8_t movingTargetEnergy();
+		uint8_t lightLevel();											//From the latest engineering frame, 0 if the firmware doesn't report it
+		bool outPinState();
+		void enableGateStatistics(bool enabled = true);					//Keep statistics of the gate energies in engineering frames, off by default
+		bool takeGateStatistics(ld2410_gate_statistics &statistics, bool reset = true);	//Copy them out, then optionally start a new window. False if there were no frames
+		void onDataFrame(ld2410_frame_callback callback, void *context = nullptr);	//Every data frame, nullptr to stop. These callbacks run inside read(), or in the radar task with LD2410_OPTION_RADAR_TASK
+		void onEngineeringFrame(ld2410_frame_callback callback, void *context = nullptr);	//Engineering mode data frames only
+		void onRawFrame(ld2410_raw_frame_callback callback, void *context = nullptr);	//The bytes of every frame that parsed, see ld2410_recorder
+		void setFrameClock(ld2410_clock_callback clock, void *context = nullptr);	//Where timestamp_us comes from, nullptr for the system timer. ld2410_replay_stream uses it to restore recorded times
+		void onPresenceChange(ld2410_presence_callback callback, void *context = nullptr);	//Only when presenceDetected() changes
+		void onAck(ld2410_ack_callback callback, void *context = nullptr);
+		void onConnectionLost(ld2410_event_callback callback, void *context = nullptr);	//Frames stopped arriving for LD2410_CONNECTION_TIMEOUT
+		uint8_t submitCommand(uint8_t command, const uint8_t *value = nullptr, uint8_t valueLength = 0, ld2410_command_callback callback = nullptr, void *context = nullptr);	//Queue a raw command, returns a handle or 0 if the queue is full
+		bool commandPending(uint8_t handle);							//Whether a queued command is still waiting to be sent or ACKed
+		uint8_t commandsPending();										//Commands queued or in flight
+		bool beginConfiguration();										//Enter configuration mode once, following set/request calls are queued until the commit
+		bool commitConfiguration();										//Leave configuration mode and wait for the batch, true if every command in it succeeded
+		uint8_t commitConfigurationAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);	//Callback reports success of the whole batch
+		bool configurationBatchOpen();
 		bool requestFirmwareVersion();									//Request the firmware version
+		uint8_t requestFirmwareVersionAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
 		uint8_t firmware_major_version = 0;								//Reported major version
 		uint8_t firmware_minor_version = 0;								//Reported minor version
 		uint32_t firmware_bugfix_version = 0;							//Reported bugfix version (coded as hex)
 		bool requestCurrentConfiguration();								//Request current configuration
+		uint8_t requestCurrentConfigurationAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
 		uint8_t max_gate = 0;
 		uint8_t max_moving_gate = 0;
 		uint8_t max_stationary_gate = 0;
 		uint16_t sensor_idle_time = 0;
 		uint8_t motion_sensitivity[9] = {0,0,0,0,0,0,0,0,0};
 		uint8_t stationary_sensitivity[9] = {0,0,0,0,0,0,0,0,0};
+		bool getConfiguration(ld2410_configuration &);					//Copy out the fields above and the firmware version, false if the configuration hasn't been read or restored
+		void restoreConfiguration(const ld2410_configuration &);		//Take a saved copy as the radar's configuration instead of requesting it, the caller vouches that it is current
 		bool requestRestart();
+		uint8_t requestRestartAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
 		bool requestFactoryReset();
+		uint8_t requestFactoryResetAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
+		bool requestMacAddress();										//Request the Bluetooth MAC address
+		uint8_t requestMacAddressAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
+		uint8_t mac_address[6] = {0,0,0,0,0,0};
+		bool setBluetooth(bool enabled);								//Takes effect after requestRestart()
+		uint8_t setBluetoothAsync(bool enabled, ld2410_command_callback callback = nullptr, void *context = nullptr);
+		bool requestDistanceResolution();
+		uint8_t requestDistanceResolutionAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
+		bool setDistanceResolution(uint8_t resolution);					//LD2410_DISTANCE_RESOLUTION_75CM or _20CM per gate, takes effect after requestRestart()
+		uint8_t setDistanceResolutionAsync(uint8_t resolution, ld2410_command_callback callback = nullptr, void *context = nullptr);
+		uint8_t distance_resolution = LD2410_DISTANCE_RESOLUTION_75CM;
 		bool requestStartEngineeringMode();
+		uint8_t requestStartEngineeringModeAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
 		bool requestEndEngineeringMode();
+		uint8_t requestEndEngineeringModeAsync(ld2410_command_callback callback = nullptr, void *context = nullptr);
 		bool setMaxValues(uint16_t moving, uint16_t stationary, uint16_t inactivityTimer);	//Realistically gate values are 0-8 but sent as uint16_t
+		uint8_t setMaxValuesAsync(uint16_t moving, uint16_t stationary, uint16_t inactivityTimer, ld2410_command_callback callback = nullptr, void *context = nullptr);
 		bool setGateSensitivityThreshold(uint8_t gate, uint8_t moving, uint8_t stationary);
-		// Engineering mode data
+		uint8_t setGateSensitivityThresholdAsync(uint8_t gate, uint8_t moving, uint8_t stationary, ld2410_command_callback callback = nullptr, void *context = nullptr);
+		bool setSensitivityProfile(const uint8_t moving[9], const uint8_t stationary[9]);	//Send only what differs from the cached sensitivities, using a broadcast where it saves commands
+		bool startCalibration(uint32_t durationMs = LD2410_CALIBRATION_TIME, uint8_t sigmaTenths = LD2410_CALIBRATION_SIGMA, ld2410_calibration_callback callback = nullptr, void *context = nullptr);	//The room must be empty. Records gate energies in engineering mode for durationMs then sets each threshold to mean + sigma standard deviations, in one batch. Doesn't block, runs from read() or the radar task
+		bool calibrating();												//Recording or applying the thresholds
+		void cancelCalibration();										//Stop recording, thresholds already being applied still are
+		void setAdaptiveEngineeringMode(bool enabled, uint32_t holdMs = LD2410_ADAPTIVE_HOLD_TIME);	//Basic frames while nobody is present, engineering frames from presence until holdMs after it ends. Switches with async commands from read() or the radar task, and stands aside during a calibration
+		bool adaptiveEngineeringMode();
+		#if defined(ESP32)
+		bool setBaudRate(uint32_t baud);								//Change the radar baud rate, restart it and follow on the host UART, false if it stayed at the old rate
+		uint32_t detectBaudRate();										//Search the supported baud rates, returns the one the radar answered at or 0
+		uint32_t baudRate();											//Supported baud rate closest to what the host UART is running at
+		#endif
+		// Engineering mode data, written as frames are parsed, so from the radar task with LD2410_OPTION_RADAR_TASK. Use latestReport() there, these are kept for older sketches
 		uint8_t engineering_moving_energy[9] = {0,0,0,0,0,0,0,0,0};		//Energy per gate for moving targets
 		uint8_t engineering_stationary_energy[9] = {0,0,0,0,0,0,0,0,0};	//Energy per gate for stationary targets
 		uint8_t engineering_moving_target_gate = 0;						//Detected moving target gate
@@ -61,30 +274,158 @@ class ld2410	{
 	private:
 		Stream *radar_uart_ = nullptr;
 		Stream *debug_uart_ = nullptr;									//The stream used for the debugging
+		#if defined(ESP32)
+		HardwareSerial *radar_hw_uart_ = nullptr;						//Set when begin() was given a hardware UART
+		bool receive_events_ = false;									//Bytes arrive through the receive callback into radar_rx_ring_
+		ld2410_ring_buffer<uint8_t, LD2410_RX_RING_SIZE> radar_rx_ring_;	//Filled by the UART receive callback, drained by read()
+		TaskHandle_t radar_task_ = nullptr;								//Owns the UART, parser and command queue with LD2410_OPTION_RADAR_TASK
+		SemaphoreHandle_t radar_mutex_ = nullptr;						//Recursive, held by the radar task while it parses and by callers touching the command queue
+		bool radar_task_paused_ = false;								//Baud rate changes drive the UART from the caller meanwhile
+		uint32_t task_read_sequence_ = 0;								//frameSequence() at the last read() while the radar task runs
+		#endif
 		uint32_t radar_uart_timeout = 100;								//How long to give up on receiving some useful data from the LD2410
 		uint32_t radar_uart_last_packet_ = 0;							//Time of the last packet from the radar
 		uint32_t radar_uart_last_command_ = 0;							//Time of the last command sent to the radar
 		uint32_t radar_uart_command_timeout_ = 100;						//Timeout for sending commands
 		uint8_t latest_ack_ = 0;
 		bool latest_command_success_ = false;
-		uint8_t radar_data_frame_[LD2410_MAX_FRAME_LENGTH];				//Store the incoming data from the radar, to check it's in a valid format
+		union	{
+			uint8_t radar_data_frame_[LD2410_MAX_FRAME_LENGTH];			//Store the incoming data from the radar, to check it's in a valid format
+			ld2410_basic_frame basic_frame_;							//The same bytes, once a complete data frame has been checked
+			ld2410_engineering_frame engineering_frame_;
+		};
 		uint8_t radar_data_frame_position_ = 0;							//Where in the frame we are currently writing
+		uint8_t radar_uart_buffer_[LD2410_UART_BUFFER_SIZE];			//Block of bytes drained from the UART in one go
 		bool frame_started_ = false;									//Whether a frame is currently being read
 		bool ack_frame_ = false;										//Whether the incoming frame is LIKELY an ACK frame
-		bool waiting_for_ack_ = false;									//Whether a command has just been sent
-		uint8_t target_type_ = 0;
-		uint16_t moving_target_distance_ = 0;
-		uint8_t moving_target_energy_ = 0;
-		uint16_t stationary_target_distance_ = 0;
-		uint8_t stationary_target_energy_ = 0;
+		bool waiting_for_ack_ = false;									//Whether the command at the head of the queue has been sent
+		struct queued_command_	{
+			uint8_t handle;
+			uint8_t command;
+			uint8_t frame[LD2410_MAX_COMMAND_FRAME_LENGTH];				//Whole command frame, built when queued so it goes out in one write
+			uint8_t frame_length;
+			ld2410_command_callback callback;
+			void *context;
+			bool batched;												//Queued between beginConfiguration() and the commit
+		};
+		queued_command_ command_queue_[LD2410_COMMAND_QUEUE_LENGTH];	//Commands are sent one at a time, in order, from read()
+		uint8_t command_queue_head_ = 0;								//Index of the command being sent or next to send
+		uint8_t command_queue_length_ = 0;
+		uint8_t next_command_handle_ = 1;
+		uint8_t blocking_leave_handle_ = 0;								//Leave command queued after the last blocking call's command, which wait_for_command_() also waits for
+		bool configuration_failed_ = false;								//Entering configuration mode failed, skip commands until the leave
+		bool configuration_batch_open_ = false;							//Between beginConfiguration() and the commit
+		uint8_t batch_failures_ = 0;									//Failed commands in the current batch
+		bool configuration_valid_ = false;								//The cached configuration has been read from the radar
+		uint32_t frame_sequence_ = 0;
+		uint64_t frame_start_us_ = 0;									//When the header of the frame being read started
+		ld2410_report history_[LD2410_HISTORY_LENGTH] = {};				//Indexed by sequence number
+		uint32_t history_read_sequence_ = 0;							//Last frame handed out by popReport()
+		uint32_t reports_dropped_ = 0;
+		ld2410_frame_callback data_frame_callback_ = nullptr;
+		void *data_frame_context_ = nullptr;
+		ld2410_frame_callback engineering_frame_callback_ = nullptr;
+		void *engineering_frame_context_ = nullptr;
+		ld2410_raw_frame_callback raw_frame_callback_ = nullptr;
+		void *raw_frame_context_ = nullptr;
+		ld2410_clock_callback frame_clock_ = nullptr;
+		void *frame_clock_context_ = nullptr;
+		ld2410_presence_callback presence_callback_ = nullptr;
+		void *presence_context_ = nullptr;
+		ld2410_ack_callback ack_callback_ = nullptr;
+		void *ack_context_ = nullptr;
+		ld2410_event_callback connection_lost_callback_ = nullptr;
+		void *connection_lost_context_ = nullptr;
+		bool gate_statistics_enabled_ = false;
+		ld2410_gate_statistics gate_statistics_;						//Updated by parse_data_frame_()
+		bool presence_ = false;											//Filtered presence of the latest frame
+		bool presence_pending_ = false;									//The unfiltered state differs from presence_
+		uint32_t presence_pending_since_ = 0;							//Frame time (ms) it started to differ
+		uint32_t presence_debounce_ = 0;
+		uint32_t presence_hold_ = 0;
+		uint8_t presence_on_energy_ = 0;
+		uint8_t presence_off_energy_ = 0;
+		#ifdef LD2410_TRACE
+		ld2410_ring_buffer<ld2410_trace_event, LD2410_TRACE_LENGTH> trace_;	//Written by the parser, read by popTrace()
+		uint32_t trace_dropped_ = 0;
+		#endif
+		ld2410_counters counters_;
+		bool connection_live_ = false;									//Frames have arrived within LD2410_CONNECTION_TIMEOUT
+		bool calibration_recording_ = false;							//startCalibration() is collecting calibration_statistics_
+		bool calibration_applying_ = false;								//The thresholds are queued, waiting for the commit
+		bool calibration_end_engineering_ = false;						//Engineering mode was started for the calibration, so end it again
+		uint32_t calibration_started_ = 0;								//millis() of the first engineering frame, or of the start until there is one
+		uint32_t calibration_duration_ = 0;
+		uint8_t calibration_sigma_ = 0;									//Tenths of a standard deviation
+		ld2410_gate_statistics calibration_statistics_;					//Kept apart from gate_statistics_ so takeGateStatistics() windows aren't disturbed
+		ld2410_calibration_callback calibration_callback_ = nullptr;
+		void *calibration_context_ = nullptr;
+		bool adaptive_enabled_ = false;
+		uint32_t adaptive_hold_ = LD2410_ADAPTIVE_HOLD_TIME;
+		bool adaptive_engineering_ = false;								//The mode the radar was last switched to, or was in when adaptive mode started
+		bool adaptive_target_ = false;									//The mode adaptive_handle_ switches to
+		uint8_t adaptive_handle_ = 0;									//Switch in flight, 0 for none
+		bool adaptive_idle_ = false;									//No presence since adaptive_idle_since_
+		uint32_t adaptive_idle_since_ = 0;
+		bool adaptive_retry_wait_ = false;								//The last switch failed at adaptive_last_attempt_
+		uint32_t adaptive_last_attempt_ = 0;
 		
-		bool read_frame_();												//Try to read a frame from the UART
+		uint8_t read_frame_();											//Drain the UART and parse any frames, returns how many completed
+		uint8_t parse_byte_(uint8_t);									//Feed one byte to the frame state machine, returns the frames it completed
+		void start_frame_(uint8_t);										//A possible header byte is at the start of the buffer
+		uint8_t scan_frame_(bool);										//Check the buffered bytes against the header, length and footer, true to check them all again after a shift
+		void shift_frame_(uint8_t);										//Drop bytes from the start of the buffer, up to the next possible header at or after this offset
+		bool dispatch_frame_();											//Parse a complete, delimited frame
+		uint8_t parse_block_(const uint8_t *, size_t);					//Feed a block of bytes to the frame state machine
+		#if defined(ESP32)
+		void receive_event_();											//Runs in the UART event task, moves received bytes into radar_rx_ring_
+		bool probe_baud_rate_(uint32_t, uint32_t);						//Switch the host UART and see if the radar answers within the timeout
+		bool set_baud_rate_(uint32_t);
+		uint32_t detect_baud_rate_();
+		bool start_radar_task_();
+		static void radar_task_loop_(void *);							//Body of the radar task, parameter is the ld2410
+		void pause_radar_task_(bool);									//Stop the radar task touching the UART so the caller can
+		bool radar_task_running_();										//The radar task is parsing, so read() must not
+		#endif
+		void lock_();													//Take radar_mutex_, if there is one
+		void unlock_();
 		bool parse_data_frame_();										//Is the current data frame valid?
+		void publish_report_(bool);										//Number, timestamp and store the data frame just parsed
+		bool update_presence_(const ld2410_report &);					//Run the presence filter on a frame, true if presence_ changed
 		bool parse_command_frame_();									//Is the current command frame valid?
+		struct ack_handler_	{
+			uint8_t length;												//Frame data length of a successful ACK, 0 for commands that aren't supported
+			void (ld2410::*parse)();									//Reads the rest of a successful ACK, nullptr if it is only a status
+		};
+		static const ack_handler_ ack_handlers_[48];					//Indexed by command, 0x60-0x6F then 0xA0-0xAF then 0xF0-0xFF
+		static const ack_handler_ *find_ack_handler_(uint8_t);
+		void parse_configuration_ack_();
+		void parse_firmware_ack_();
+		void parse_mac_address_ack_();
+		void parse_distance_resolution_ack_();
+		#ifdef LD2410_DEBUG_ANY
 		void print_frame_();											//Print the frame for debugging
-		void send_command_preamble_();									//Commands have the same preamble
-		void send_command_postamble_();									//Commands have the same postamble
-		bool enter_configuration_mode_();								//Necessary before sending any command
-		bool leave_configuration_mode_();								//Will not read values without leaving command mode
+		#endif
+		#ifdef LD2410_TRACE
+		void trace_event_(uint8_t, uint8_t, uint16_t);
+		#endif
+		void process_commands_();										//Time out the command in flight and send the next one
+		void send_next_command_();										//Skip commands that can't succeed and send the head of the queue
+		void send_queued_command_();									//Write the command at the head of the queue
+		void acknowledge_command_(bool);								//Complete the command in flight if the current frame is its ACK
+		void complete_command_(bool);									//Remove the head of the queue and run its callback
+		uint8_t submit_configuration_command_(uint8_t, const uint8_t *, uint8_t, ld2410_command_callback, void *);	//Queue a command wrapped in enter/leave configuration mode, or into the open batch
+		void mark_batched_(uint8_t);									//Flag the most recently queued command as part of the batch
+		bool wait_for_command_(uint8_t, bool &);						//Blocking helper, runs read() until the queue is empty
+		static void blocking_command_callback_(ld2410 &, uint8_t, uint8_t, bool, void *);
+		void update_cached_configuration_(const queued_command_ &);		//Keep the public configuration fields in step with ACKed changes
+		void check_connection_(uint8_t);								//Run connection_lost_callback_ when frames stop
+		bool queue_sensitivity_profile_(const uint8_t *, const uint8_t *);	//Queue the commands setSensitivityProfile() needs into the open batch
+		void process_calibration_();									//Apply the thresholds once the calibration window is over
+		void process_adaptive_engineering_();							//Switch engineering mode to follow presence_
+		static void adaptive_command_callback_(ld2410 &, uint8_t, uint8_t, bool, void *);
+		uint8_t calibration_threshold_(uint8_t);						//Noise floor plus margin for one of the 18 gates
+		void finish_calibration_(bool);									//Run calibration_callback_ and go idle
+		static void calibration_commit_callback_(ld2410 &, uint8_t, uint8_t, bool, void *);
 };
 #endif
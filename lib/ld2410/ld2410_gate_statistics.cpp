@@ -0,0 +1,97 @@
+/*
+ *	Fixed point per-gate statistics for the ld2410 library, with no allocation.
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_gate_statistics_cpp
+#define ld2410_gate_statistics_cpp
+#include "ld2410_gate_statistics.h"
+
+void ld2410_gate_statistics::reset()
+{
+	frames_ = 0;	//update() reseeds the window from the next frame, the moving average carries on
+}
+
+void ld2410_gate_statistics::update(const uint8_t moving[9], const uint8_t stationary[9])
+{
+	uint8_t energy_[LD2410_STATISTICS_GATES];
+	for(uint8_t i = 0; i < 9; i++)
+	{
+		energy_[i] = moving[i];
+		energy_[9 + i] = stationary[i];
+	}
+	for(uint8_t i = 0; i < LD2410_STATISTICS_GATES; i++)
+	{
+		int32_t sample_ = energy_[i] << 8;
+		ema_[i] = ema_seeded_ ? ema_[i] + ((sample_ - ema_[i]) >> LD2410_STATISTICS_EMA_SHIFT) : sample_;
+	}
+	ema_seeded_ = true;
+	if(frames_ == 0)	//First frame of a window
+	{
+		for(uint8_t i = 0; i < LD2410_STATISTICS_GATES; i++)
+		{
+			sum_[i] = 0;
+			sum_squares_[i] = 0;
+			minimum_[i] = energy_[i];
+			maximum_[i] = energy_[i];
+		}
+	}
+	else if(frames_ == LD2410_STATISTICS_MAX_FRAMES)	//Hold the window rather than overflow, the average still follows
+	{
+		return;
+	}
+	for(uint8_t i = 0; i < LD2410_STATISTICS_GATES; i++)
+	{
+		sum_[i] += energy_[i];
+		sum_squares_[i] += (uint32_t)energy_[i] * energy_[i];
+		minimum_[i] = energy_[i] < minimum_[i] ? energy_[i] : minimum_[i];
+		maximum_[i] = energy_[i] > maximum_[i] ? energy_[i] : maximum_[i];
+	}
+	frames_++;
+}
+
+uint16_t ld2410_gate_statistics::frames()
+{
+	return frames_;
+}
+
+uint16_t ld2410_gate_statistics::averageFixed(uint8_t gate)
+{
+	return gate < LD2410_STATISTICS_GATES ? ema_[gate] : 0;
+}
+
+uint8_t ld2410_gate_statistics::average(uint8_t gate)
+{
+	return gate < LD2410_STATISTICS_GATES ? (ema_[gate] + 0x80) >> 8 : 0;
+}
+
+uint8_t ld2410_gate_statistics::mean(uint8_t gate)
+{
+	if(gate >= LD2410_STATISTICS_GATES || frames_ == 0)
+	{
+		return 0;
+	}
+	return (sum_[gate] + frames_ / 2) / frames_;
+}
+
+uint16_t ld2410_gate_statistics::variance(uint8_t gate)
+{
+	if(gate >= LD2410_STATISTICS_GATES || frames_ == 0)
+	{
+		return 0;
+	}
+	uint64_t total_ = sum_[gate];
+	return (sum_squares_[gate] * (uint64_t)frames_ - total_ * total_) / ((uint64_t)frames_ * frames_);	//E[x^2] - E[x]^2 without losing the fraction of the mean
+}
+
+uint8_t ld2410_gate_statistics::minimum(uint8_t gate)
+{
+	return gate < LD2410_STATISTICS_GATES && frames_ > 0 ? minimum_[gate] : 0;
+}
+
+uint8_t ld2410_gate_statistics::maximum(uint8_t gate)
+{
+	return gate < LD2410_STATISTICS_GATES && frames_ > 0 ? maximum_[gate] : 0;
+}
+#endif
@@ -0,0 +1,40 @@
+/*
+ *	Fixed point per-gate statistics for the ld2410 library, with no allocation.
+ *
+ *	The 9 moving and 9 stationary gate energies are kept as one run of 18 so each update is a few fixed-length loops with no branches in them, which the compiler can unroll.
+ *	Averages use 8.8 fixed point. The sums behind mean() and variance() cover every frame since reset() and stop growing after LD2410_STATISTICS_MAX_FRAMES.
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_gate_statistics_h
+#define ld2410_gate_statistics_h
+#include <stdint.h>
+
+#define LD2410_STATISTICS_GATES 18										//Moving gates 0-8 then stationary gates 0-8
+#define LD2410_STATISTICS_EMA_SHIFT 3									//Moving average weight of each new frame is 1/2^shift
+#define LD2410_STATISTICS_MAX_FRAMES 0xFFFF								//Frames the sums can take before they could overflow
+
+class ld2410_gate_statistics	{
+
+	public:
+		void reset();													//Start a new window
+		void update(const uint8_t moving[9], const uint8_t stationary[9]);	//Add one frame of gate energies
+		uint16_t frames();												//Frames since reset()
+		uint16_t averageFixed(uint8_t gate);							//Exponential moving average in 8.8 fixed point, gate 0-17
+		uint8_t average(uint8_t gate);									//Exponential moving average, rounded
+		uint8_t mean(uint8_t gate);										//Mean since reset(), rounded
+		uint16_t variance(uint8_t gate);								//Population variance since reset(), in energy squared
+		uint8_t minimum(uint8_t gate);
+		uint8_t maximum(uint8_t gate);
+	protected:
+	private:
+		uint16_t ema_[LD2410_STATISTICS_GATES] = {};					//8.8 fixed point
+		uint32_t sum_[LD2410_STATISTICS_GATES] = {};
+		uint32_t sum_squares_[LD2410_STATISTICS_GATES] = {};			//At most 255^2 * LD2410_STATISTICS_MAX_FRAMES, fits
+		uint8_t minimum_[LD2410_STATISTICS_GATES] = {};
+		uint8_t maximum_[LD2410_STATISTICS_GATES] = {};
+		uint16_t frames_ = 0;
+		bool ema_seeded_ = false;										//The first frame ever sets the average outright
+};
+#endif
@@ -0,0 +1,202 @@
+/*
+ *	Services several LD2410 radars from one sketch, each on its own UART.
+ *
+ *	https://github.com/ncmreynolds/ld2410
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_manager_cpp
+#define ld2410_manager_cpp
+#include "ld2410_manager.h"
+
+bool ld2410_manager::addSensor(ld2410 &radar, uint8_t id)
+{
+	if(sensor_count_ >= LD2410_MANAGER_MAX_SENSORS)
+	{
+		return false;
+	}
+	sensor_ &entry = sensors_[sensor_count_++];
+	entry.radar = &radar;
+	entry.id = id;
+	entry.last_sequence = radar.frameSequence();
+	entry.last_frame_time = millis() - LD2410_MANAGER_STALE_TIMEOUT;	//Not active until it sends a frame
+	entry.command_success = false;
+	return true;
+}
+
+uint8_t ld2410_manager::sensorCount()
+{
+	return sensor_count_;
+}
+
+ld2410 *ld2410_manager::sensor(uint8_t index)
+{
+	if(index >= sensor_count_)
+	{
+		return nullptr;
+	}
+	return sensors_[index].radar;
+}
+
+uint8_t ld2410_manager::sensorId(uint8_t index)
+{
+	if(index >= sensor_count_)
+	{
+		return 0;
+	}
+	return sensors_[index].id;
+}
+
+uint8_t ld2410_manager::read()
+{
+	uint8_t frames_read_ = 0;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		sensor_ &entry = sensors_[(next_sensor_ + i) % sensor_count_];
+		frames_read_ += entry.radar->read();
+		uint32_t sequence_ = entry.radar->frameSequence();	//Catches frames parsed by a radar task too
+		if(sequence_ != entry.last_sequence)
+		{
+			entry.last_sequence = sequence_;
+			entry.last_frame_time = millis();
+		}
+	}
+	if(sensor_count_ > 0)
+	{
+		next_sensor_ = (next_sensor_ + 1) % sensor_count_;
+	}
+	return frames_read_;
+}
+
+bool ld2410_manager::sensorActive(uint8_t index)
+{
+	if(index >= sensor_count_)
+	{
+		return false;
+	}
+	return millis() - sensors_[index].last_frame_time < LD2410_MANAGER_STALE_TIMEOUT;
+}
+
+uint8_t ld2410_manager::presenceMask()
+{
+	uint8_t mask_ = 0;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		if(sensorActive(i) && sensors_[i].radar->presenceDetected())
+		{
+			mask_ |= 1 << i;
+		}
+	}
+	return mask_;
+}
+
+bool ld2410_manager::presenceDetected()
+{
+	return presenceMask() != 0;
+}
+
+uint16_t ld2410_manager::nearestTargetDistance()
+{
+	uint16_t nearest_ = 0;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		if(sensorActive(i) == false)
+		{
+			continue;
+		}
+		ld2410_report report_;
+		sensors_[i].radar->latestReport(report_);
+		if((report_.target_type & 0x01) && report_.moving_target_distance > 0 && (nearest_ == 0 || report_.moving_target_distance < nearest_))
+		{
+			nearest_ = report_.moving_target_distance;
+		}
+		if((report_.target_type & 0x02) && report_.stationary_target_distance > 0 && (nearest_ == 0 || report_.stationary_target_distance < nearest_))
+		{
+			nearest_ = report_.stationary_target_distance;
+		}
+	}
+	return nearest_;
+}
+
+uint32_t ld2410_manager::command_timeouts_()
+{
+	uint32_t timeouts_ = 0;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		ld2410_counters counters_;
+		sensors_[i].radar->getCounters(counters_);
+		timeouts_ += counters_.command_timeouts;
+	}
+	return timeouts_;
+}
+
+bool ld2410_manager::waitForCommands()
+{
+	uint32_t timeouts_ = command_timeouts_();
+	for(;;)
+	{
+		uint8_t pending_ = 0;
+		for(uint8_t i = 0; i < sensor_count_; i++)
+		{
+			pending_ += sensors_[i].radar->commandsPending();
+		}
+		if(pending_ == 0)
+		{
+			return command_timeouts_() == timeouts_;
+		}
+		if(read() == 0)	//Every sensor's commands time out in parallel, so this is bounded by the slowest one
+		{
+			delay(1);
+		}
+	}
+}
+
+void ld2410_manager::command_callback_(ld2410 &radar, uint8_t handle, uint8_t command, bool success, void *context)
+{
+	(void)radar;
+	(void)handle;
+	(void)command;
+	((sensor_ *)context)->command_success = success;
+}
+
+bool ld2410_manager::request_all_(async_request_ request)
+{
+	bool queued_ = true;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		sensors_[i].command_success = false;
+		if((sensors_[i].radar->*request)(command_callback_, &sensors_[i]) == 0)
+		{
+			queued_ = false;
+		}
+	}
+	waitForCommands();
+	bool success_ = queued_;
+	for(uint8_t i = 0; i < sensor_count_; i++)
+	{
+		success_ = success_ && sensors_[i].command_success;
+	}
+	return success_;
+}
+
+bool ld2410_manager::requestFirmwareVersion()
+{
+	return request_all_(&ld2410::requestFirmwareVersionAsync);
+}
+
+bool ld2410_manager::requestCurrentConfiguration()
+{
+	return request_all_(&ld2410::requestCurrentConfigurationAsync);
+}
+
+bool ld2410_manager::requestStartEngineeringMode()
+{
+	return request_all_(&ld2410::requestStartEngineeringModeAsync);
+}
+
+bool ld2410_manager::requestEndEngineeringMode()
+{
+	return request_all_(&ld2410::requestEndEngineeringModeAsync);
+}
+#endif
@@ -0,0 +1,54 @@
+/*
+ *	Services several LD2410 radars from one sketch, each on its own UART.
+ *
+ *	Sensors are read round robin and commands are sent to all of them at once, so waiting for an answer takes as long as the slowest sensor rather than the sum of them.
+ *
+ *	https://github.com/ncmreynolds/ld2410
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_manager_h
+#define ld2410_manager_h
+#include <Arduino.h>
+#include "ld2410.h"
+
+#define LD2410_MANAGER_MAX_SENSORS 4									//Sensors one manager can service
+#define LD2410_MANAGER_STALE_TIMEOUT 1000								//A sensor with no data frame for this long (ms) is left out of the fused presence
+
+class ld2410_manager	{
+
+	public:
+		bool addSensor(ld2410 &radar, uint8_t id);						//Service an already started sensor, id is how telemetry tells them apart
+		uint8_t sensorCount();
+		ld2410 *sensor(uint8_t index);									//nullptr past sensorCount()
+		uint8_t sensorId(uint8_t index);
+		uint8_t read();													//Read every sensor once, starting from a different one each call, returns the total number of frames
+		bool sensorActive(uint8_t index);								//Has sent a data frame within LD2410_MANAGER_STALE_TIMEOUT
+		uint8_t presenceMask();											//Bit per sensor index, set for active sensors that detect a target
+		bool presenceDetected();										//Fused presence, any active sensor detects a target
+		uint16_t nearestTargetDistance();								//Closest moving or stationary target seen by an active sensor, 0 for none
+		bool waitForCommands();											//Keep reading every sensor until none has commands queued, false if any of them timed out meanwhile
+		bool requestFirmwareVersion();									//These send the request to every sensor and wait once, true if all succeeded
+		bool requestCurrentConfiguration();
+		bool requestStartEngineeringMode();
+		bool requestEndEngineeringMode();
+	protected:
+	private:
+		struct sensor_	{
+			ld2410 *radar;
+			uint8_t id;
+			uint32_t last_sequence;										//frameSequence() when a new frame was last seen
+			uint32_t last_frame_time;									//millis() then
+			bool command_success;										//Outcome of the last request_all_()
+		};
+		sensor_ sensors_[LD2410_MANAGER_MAX_SENSORS];
+		uint8_t sensor_count_ = 0;
+		uint8_t next_sensor_ = 0;										//Read first on the next read(), so no sensor is always last
+
+		typedef uint8_t (ld2410::*async_request_)(ld2410_command_callback, void *);
+		bool request_all_(async_request_);								//Queue the same request on every sensor then wait for them together
+		uint32_t command_timeouts_();									//Summed over every sensor's counters
+		static void command_callback_(ld2410 &, uint8_t, uint8_t, bool, void *);
+};
+#endif
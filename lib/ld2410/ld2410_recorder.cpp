@@ -0,0 +1,417 @@
+/*
+ *	Records the raw frames an LD2410 sends, to flash or any other Print, and replays them into ld2410::read() later.
+ *
+ *	https://github.com/ncmreynolds/ld2410
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_recorder_cpp
+#define ld2410_recorder_cpp
+#include "ld2410_recorder.h"
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+static inline uint64_t ld2410_replay_time_us_()
+{
+	#if defined(ESP32)
+	return esp_timer_get_time();
+	#else
+	return micros();
+	#endif
+}
+
+ld2410_recorder::ld2410_recorder()	//Constructor function
+{
+}
+
+ld2410_recorder::~ld2410_recorder()	//Destructor function
+{
+	end();
+	#if defined(ESP32)
+	if(mutex_ != nullptr)
+	{
+		vSemaphoreDelete(mutex_);
+	}
+	#endif
+}
+
+bool ld2410_recorder::begin(Print &output, uint32_t capacity, uint32_t existing)
+{
+	#if defined(ESP32)
+	if(mutex_ == nullptr)
+	{
+		mutex_ = xSemaphoreCreateRecursiveMutex();
+		if(mutex_ == nullptr)
+		{
+			return false;
+		}
+	}
+	#endif
+	if(existing + LD2410_RECORDER_BLOCK_SIZE > capacity)
+	{
+		return false;
+	}
+	lock_();
+	output_ = &output;
+	capacity_ = capacity;
+	bytes_written_ = existing;
+	staged_bytes_ = existing;
+	frames_recorded_ = 0;
+	frames_dropped_ = 0;
+	active_block_ = 0;
+	block_fill_[0] = 0;
+	block_fill_[1] = 0;
+	block_pending_ = false;
+	block_limit_ = LD2410_RECORDER_BLOCK_SIZE - (existing % LD2410_RECORDER_BLOCK_SIZE);	//Fill to the next block boundary first
+	full_ = false;
+	if(existing == 0)
+	{
+		stage_((const uint8_t *)LD2410_RECORDING_MAGIC, LD2410_RECORDING_MAGIC_LENGTH);
+	}
+	recording_ = true;
+	unlock_();
+	return true;
+}
+
+#if defined(ESP32)
+bool ld2410_recorder::begin(fs::FS &filesystem, const char *path, uint32_t capacity)
+{
+	end();
+	file_ = filesystem.open(path, FILE_APPEND, true);
+	if(!file_)
+	{
+		return false;
+	}
+	if(begin(file_, capacity, file_.size()) == false)
+	{
+		file_.close();
+		return false;
+	}
+	return true;
+}
+#endif
+
+void ld2410_recorder::attach(ld2410 &radar)
+{
+	radar.onRawFrame(raw_frame_callback_, this);
+}
+
+void ld2410_recorder::detach(ld2410 &radar)
+{
+	radar.onRawFrame(nullptr);
+}
+
+bool ld2410_recorder::record(const uint8_t *frame, uint8_t length, uint64_t timestamp_us, uint32_t sequence)
+{
+	ld2410_record_header header_;
+	header_.length = length;
+	header_.sequence = sequence;
+	header_.timestamp_us = timestamp_us;
+	uint16_t size_ = sizeof(header_) + length;
+	lock_();
+	if(recording_ == false)
+	{
+		unlock_();
+		return false;
+	}
+	uint32_t space_ = block_limit_ - block_fill_[active_block_] + (block_pending_ ? 0 : LD2410_RECORDER_BLOCK_SIZE);
+	if(staged_bytes_ + size_ > capacity_)
+	{
+		full_ = true;
+	}
+	if(full_ == true || size_ > space_)	//Both blocks full means service() has fallen behind, drop rather than wait on flash
+	{
+		frames_dropped_++;
+		unlock_();
+		return false;
+	}
+	stage_((const uint8_t *)&header_, sizeof(header_));
+	stage_(frame, length);
+	frames_recorded_++;
+	unlock_();
+	return true;
+}
+
+void ld2410_recorder::stage_(const uint8_t *bytes, uint16_t length)
+{
+	staged_bytes_ += length;
+	while(length > 0)
+	{
+		uint16_t room_ = block_limit_ - block_fill_[active_block_];
+		uint16_t chunk_ = length < room_ ? length : room_;	//Records run across block boundaries, so every write is a whole block
+		memcpy(&blocks_[active_block_][block_fill_[active_block_]], bytes, chunk_);
+		block_fill_[active_block_] += chunk_;
+		bytes += chunk_;
+		length -= chunk_;
+		if(block_fill_[active_block_] == block_limit_)
+		{
+			swap_blocks_();
+			block_limit_ = LD2410_RECORDER_BLOCK_SIZE;
+		}
+	}
+}
+
+void ld2410_recorder::swap_blocks_()
+{
+	block_pending_ = true;
+	active_block_ ^= 1;
+	block_fill_[active_block_] = 0;
+}
+
+uint32_t ld2410_recorder::service()
+{
+	lock_();
+	if(block_pending_ == false || output_ == nullptr)
+	{
+		unlock_();
+		return 0;
+	}
+	uint8_t block_ = active_block_ ^ 1;
+	unlock_();	//record() never touches a pending block, so the write can happen without the lock
+	size_t written_ = output_->write(blocks_[block_], block_fill_[block_]);
+	#if defined(ESP32)
+	if(file_)
+	{
+		file_.flush();	//Commit the block, so a power cut loses at most what is still in RAM
+	}
+	#endif
+	lock_();
+	bytes_written_ += written_;
+	block_pending_ = false;
+	unlock_();
+	return written_;
+}
+
+uint32_t ld2410_recorder::flush()
+{
+	uint32_t written_ = service();
+	lock_();
+	uint16_t fill_ = block_fill_[active_block_];
+	if(fill_ > 0 && block_pending_ == false)	//Else record() filled a block since, and that goes first
+	{
+		swap_blocks_();	//The other block was written just now
+		block_limit_ = LD2410_RECORDER_BLOCK_SIZE - ((bytes_written_ + fill_) % LD2410_RECORDER_BLOCK_SIZE);
+	}
+	unlock_();
+	return written_ + service();
+}
+
+void ld2410_recorder::end()
+{
+	if(recording_ == false)
+	{
+		return;
+	}
+	flush();
+	lock_();
+	recording_ = false;
+	output_ = nullptr;
+	unlock_();
+	#if defined(ESP32)
+	if(file_)
+	{
+		file_.close();
+	}
+	#endif
+}
+
+bool ld2410_recorder::recording()
+{
+	return recording_;
+}
+
+bool ld2410_recorder::full()
+{
+	return full_;
+}
+
+uint32_t ld2410_recorder::framesRecorded()
+{
+	return frames_recorded_;
+}
+
+uint32_t ld2410_recorder::framesDropped()
+{
+	return frames_dropped_;
+}
+
+uint32_t ld2410_recorder::bytesWritten()
+{
+	return bytes_written_;
+}
+
+void ld2410_recorder::lock_()
+{
+	#if defined(ESP32)
+	if(mutex_ != nullptr)
+	{
+		xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+	}
+	#endif
+}
+
+void ld2410_recorder::unlock_()
+{
+	#if defined(ESP32)
+	if(mutex_ != nullptr)
+	{
+		xSemaphoreGiveRecursive(mutex_);
+	}
+	#endif
+}
+
+void ld2410_recorder::raw_frame_callback_(ld2410 &radar, const uint8_t *frame, uint8_t length, uint64_t timestamp_us, uint32_t sequence, void *context)
+{
+	(void)radar;
+	((ld2410_recorder *)context)->record(frame, length, timestamp_us, sequence);
+}
+
+ld2410_replay_stream::ld2410_replay_stream(Stream &recording, bool realTime)
+	: recording_(&recording), real_time_(realTime)
+{
+}
+
+bool ld2410_replay_stream::begin()
+{
+	char magic_[LD2410_RECORDING_MAGIC_LENGTH];
+	for(uint8_t i = 0; i < LD2410_RECORDING_MAGIC_LENGTH; i++)
+	{
+		int byte_ = recording_->read();
+		if(byte_ < 0)
+		{
+			finished_ = true;
+			return false;
+		}
+		magic_[i] = byte_;
+	}
+	finished_ = memcmp(magic_, LD2410_RECORDING_MAGIC, LD2410_RECORDING_MAGIC_LENGTH) != 0;
+	return finished_ == false;
+}
+
+void ld2410_replay_stream::attach(ld2410 &radar)
+{
+	radar.setFrameClock(frame_clock_, this);
+}
+
+void ld2410_replay_stream::detach(ld2410 &radar)
+{
+	radar.setFrameClock(nullptr);
+}
+
+bool ld2410_replay_stream::finished()
+{
+	return finished_ && frame_position_ == frame_length_;
+}
+
+uint32_t ld2410_replay_stream::framesReplayed()
+{
+	return frames_replayed_;
+}
+
+uint32_t ld2410_replay_stream::sequence()
+{
+	return sequence_;
+}
+
+uint64_t ld2410_replay_stream::timestamp()
+{
+	return timestamp_us_;
+}
+
+bool ld2410_replay_stream::next_frame_()
+{
+	if(finished_ == true)
+	{
+		return false;
+	}
+	if(header_loaded_ == false)
+	{
+		uint8_t *bytes_ = (uint8_t *)&header_;
+		for(uint8_t i = 0; i < sizeof(header_); i++)
+		{
+			int byte_ = recording_->read();
+			if(byte_ < 0)
+			{
+				finished_ = true;	//The end of the recording, or one cut short by a power cut
+				return false;
+			}
+			bytes_[i] = byte_;
+		}
+		if(header_.length > LD2410_MAX_FRAME_LENGTH || header_.length < 10)
+		{
+			finished_ = true;	//Not a record header, the recording is damaged
+			return false;
+		}
+		header_loaded_ = true;
+	}
+	if(real_time_ == true)
+	{
+		if(frames_replayed_ == 0)
+		{
+			first_timestamp_us_ = header_.timestamp_us;
+			started_us_ = ld2410_replay_time_us_();
+		}
+		else if(ld2410_replay_time_us_() - started_us_ < header_.timestamp_us - first_timestamp_us_)
+		{
+			return false;	//Not due yet
+		}
+	}
+	for(uint8_t i = 0; i < header_.length; i++)
+	{
+		int byte_ = recording_->read();
+		if(byte_ < 0)
+		{
+			finished_ = true;
+			return false;
+		}
+		frame_[i] = byte_;
+	}
+	header_loaded_ = false;
+	frame_length_ = header_.length;
+	frame_position_ = 0;
+	sequence_ = header_.sequence;
+	timestamp_us_ = header_.timestamp_us;
+	frames_replayed_++;
+	return true;
+}
+
+int ld2410_replay_stream::available()
+{
+	if(frame_position_ == frame_length_ && next_frame_() == false)
+	{
+		return 0;
+	}
+	return frame_length_ - frame_position_;
+}
+
+int ld2410_replay_stream::read()
+{
+	if(available() == 0)
+	{
+		return -1;
+	}
+	return frame_[frame_position_++];
+}
+
+int ld2410_replay_stream::peek()
+{
+	if(available() == 0)
+	{
+		return -1;
+	}
+	return frame_[frame_position_];
+}
+
+uint64_t ld2410_replay_stream::frame_clock_(void *context)
+{
+	return ((ld2410_replay_stream *)context)->timestamp_us_;	//One frame is released at a time, so a header being read belongs to the frame released last
+}
+
+size_t ld2410_replay_stream::write(uint8_t byte)
+{
+	(void)byte;
+	return 1;
+}
+#endif
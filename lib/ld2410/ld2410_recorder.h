@@ -0,0 +1,111 @@
+/*
+ *	Records the raw frames an LD2410 sends, to flash or any other Print, and replays them into ld2410::read() later.
+ *
+ *	Frames are staged in RAM while they are parsed and written out a whole LD2410_RECORDER_BLOCK_SIZE at a time from loop(), so recording never waits on flash and the file only ever grows by whole, aligned blocks.
+ *
+ *	https://github.com/ncmreynolds/ld2410
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_recorder_h
+#define ld2410_recorder_h
+#include <Arduino.h>
+#include "ld2410.h"
+#if defined(ESP32)
+#include <FS.h>
+#endif
+
+#define LD2410_RECORDER_BLOCK_SIZE 4096									//Bytes per write, a LittleFS block on ESP32. Two of these are staged in RAM
+#define LD2410_RECORDING_MAGIC "LD2410R1"								//First bytes of a recording, without the terminator
+#define LD2410_RECORDING_MAGIC_LENGTH 8
+
+struct __attribute__((packed)) ld2410_record_header	{					//Before each frame in a recording
+	uint8_t length;														//Frame bytes that follow, header to footer
+	uint32_t sequence;													//Data frame sequence number when it was parsed
+	uint64_t timestamp_us;												//When its header started arriving
+};
+
+class ld2410_recorder	{
+
+	public:
+		ld2410_recorder();
+		~ld2410_recorder();
+		bool begin(Print &output, uint32_t capacity, uint32_t existing = 0);	//Record until output holds capacity bytes. existing is how many it has already, 0 starts a new recording
+		#if defined(ESP32)
+		bool begin(fs::FS &filesystem, const char *path, uint32_t capacity);	//Append to a recording file, creating it if need be. Fails if less than a block of capacity is left
+		#endif
+		void attach(ld2410 &radar);										//Record every frame it parses, inside read() or in the radar task
+		void detach(ld2410 &radar);
+		bool record(const uint8_t *frame, uint8_t length, uint64_t timestamp_us, uint32_t sequence);	//Stage a frame in RAM, false if it was dropped because the buffers or the capacity are full
+		uint32_t service();												//Write out a full block if there is one, call from loop(). Returns the bytes written
+		uint32_t flush();												//Also write out the partly filled block, the next write is shortened to get back into alignment
+		void end();														//Flush, then stop recording and close the file begin() opened
+		bool recording();
+		bool full();													//Capacity reached, frames are being dropped
+		uint32_t framesRecorded();
+		uint32_t framesDropped();
+		uint32_t bytesWritten();										//Including what was there at begin()
+	protected:
+	private:
+		Print *output_ = nullptr;
+		#if defined(ESP32)
+		fs::File file_;
+		SemaphoreHandle_t mutex_ = nullptr;								//record() runs in the radar task with LD2410_OPTION_RADAR_TASK, service() in loop()
+		#endif
+		uint8_t blocks_[2][LD2410_RECORDER_BLOCK_SIZE];
+		uint16_t block_fill_[2] = {0, 0};
+		uint16_t block_limit_ = LD2410_RECORDER_BLOCK_SIZE;				//Size of the block being filled, less than a block only to get back into alignment
+		uint8_t active_block_ = 0;										//Being filled by record()
+		bool block_pending_ = false;									//The other block is full and waiting for service()
+		uint32_t capacity_ = 0;
+		uint32_t staged_bytes_ = 0;										//Written plus staged, checked against capacity_
+		uint32_t bytes_written_ = 0;
+		uint32_t frames_recorded_ = 0;
+		uint32_t frames_dropped_ = 0;
+		bool recording_ = false;
+		bool full_ = false;
+
+		void lock_();
+		void unlock_();
+		void stage_(const uint8_t *, uint16_t);							//Copy into the active block, moving on to the other one when it fills
+		void swap_blocks_();
+		static void raw_frame_callback_(ld2410 &, const uint8_t *, uint8_t, uint64_t, uint32_t, void *);
+};
+
+class ld2410_replay_stream : public Stream	{						//Feeds the frames of a recording to ld2410::begin()/read() in place of the radar's UART
+
+	public:
+		ld2410_replay_stream(Stream &recording, bool realTime = false);	//realTime holds each frame back until as long after the first as when it was recorded
+		bool begin();													//Check the recording starts with LD2410_RECORDING_MAGIC
+		void attach(ld2410 &radar);										//Stamp the frames it parses with their recorded times rather than the time they are replayed
+		void detach(ld2410 &radar);
+		bool finished();												//Every frame has been read
+		uint32_t framesReplayed();
+		uint32_t sequence();											//Recorded sequence number of the frame being replayed
+		uint64_t timestamp();											//Recorded timestamp of the frame being replayed
+		int available() override;
+		int read() override;
+		int peek() override;
+		size_t write(uint8_t) override;									//Commands are accepted and go nowhere
+		using Print::write;
+	protected:
+	private:
+		Stream *recording_;
+		bool real_time_;
+		ld2410_record_header header_ = {};
+		bool header_loaded_ = false;									//header_ is for the next frame, not yet released
+		uint8_t frame_[LD2410_MAX_FRAME_LENGTH];
+		uint8_t frame_length_ = 0;
+		uint8_t frame_position_ = 0;
+		uint32_t sequence_ = 0;
+		uint64_t timestamp_us_ = 0;
+		uint64_t first_timestamp_us_ = 0;
+		uint64_t started_us_ = 0;										//When the first frame was released
+		uint32_t frames_replayed_ = 0;
+		bool finished_ = false;
+
+		bool next_frame_();												//Release the next frame if it's due, false if there isn't one yet
+		static uint64_t frame_clock_(void *);
+};
+#endif
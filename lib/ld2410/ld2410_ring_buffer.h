@@ -0,0 +1,75 @@
+/*
+ *	Single producer, single consumer lock-free ring buffer used by the ld2410 library.
+ *
+ *	One context (e.g. a UART receive callback) may call push()/write() while another context calls pop()/read() without any locking.
+ *	The indices are free running and only ever written by their owning side, with acquire/release ordering on the hand-over.
+ *
+ *	Released under LGPL-2.1 see https://github.com/ncmreynolds/ld2410/LICENSE for full license
+ *
+ */
+#ifndef ld2410_ring_buffer_h
+#define ld2410_ring_buffer_h
+#include <stdint.h>
+
+template<typename T, uint16_t N>
+class ld2410_ring_buffer	{
+
+	static_assert(N > 0 && (N & (N - 1)) == 0 && N <= 0x8000, "ld2410_ring_buffer length must be a power of two no larger than 32768");
+
+	public:
+		uint16_t available() const										//Entries waiting to be read
+		{
+			return __atomic_load_n(&head_, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+		}
+		uint16_t space() const											//Entries that can be written without dropping any
+		{
+			return N - available();
+		}
+		bool push(const T &value)										//Producer side, fails if the buffer is full
+		{
+			return write(&value, 1) == 1;
+		}
+		uint16_t write(const T *values, uint16_t count)					//Producer side, returns how many were stored
+		{
+			uint16_t head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+			uint16_t free = N - (head - __atomic_load_n(&tail_, __ATOMIC_ACQUIRE));
+			if(count > free)
+			{
+				count = free;
+			}
+			for(uint16_t i = 0; i < count; i++)
+			{
+				buffer_[(head + i) & (N - 1)] = values[i];
+			}
+			__atomic_store_n(&head_, (uint16_t)(head + count), __ATOMIC_RELEASE);
+			return count;
+		}
+		bool pop(T &value)												//Consumer side, fails if the buffer is empty
+		{
+			return read(&value, 1) == 1;
+		}
+		uint16_t read(T *values, uint16_t count)						//Consumer side, returns how many were copied out
+		{
+			uint16_t tail = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+			uint16_t used = __atomic_load_n(&head_, __ATOMIC_ACQUIRE) - tail;
+			if(count > used)
+			{
+				count = used;
+			}
+			for(uint16_t i = 0; i < count; i++)
+			{
+				values[i] = buffer_[(tail + i) & (N - 1)];
+			}
+			__atomic_store_n(&tail_, (uint16_t)(tail + count), __ATOMIC_RELEASE);
+			return count;
+		}
+		void clear()													//Consumer side, discard everything waiting
+		{
+			__atomic_store_n(&tail_, __atomic_load_n(&head_, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		}
+	private:
+		T buffer_[N];
+		uint16_t head_ = 0;												//Only written by the producer
+		uint16_t tail_ = 0;												//Only written by the consumer
+};
+#endif
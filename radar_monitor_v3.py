@@ -7,8 +7,6 @@ import sys
 import re
 import serial
 import serial.tools.list_ports
-from collections import deque
-from datetime import datetime
 import numpy as np
 
 from PyQt5.QtWidgets import (QApplication, QMainWindow, QWidget, QVBoxLayout, 
@@ -19,43 +17,76 @@ from PyQt5.QtGui import QPainter, QColor, QPen, QFont, QBrush, QPainterPath
 import pyqtgraph as pg
 import math
 
+from radar_telemetry import TelemetryStream, RECORD_CONFIG, FLAG_ENGINEERING
+
+READ_TIMEOUT = 0.05     # s, longest a read waits for the first byte, so stop() is noticed
+REDRAW_INTERVAL = 100   # ms between redraws from the sensor histories
+HISTORY_SECONDS = 120   # Span of the time plots
+
+# Commands sent on connect for each output mode, text is the fallback for firmware without binary telemetry
+MODES = {
+    "Binary delta": [b"BINARY_ON", b"STREAM_ON", b"DELTA_ON"],
+    "Binary": [b"BINARY_ON", b"STREAM_ON", b"DELTA_OFF"],
+    "Text": [b"BINARY_OFF", b"STREAM_OFF"],
+}
+RESTORE_MODE = MODES["Text"]  # Left on disconnect, for tools that only read text
+
 
 class SerialReader(QThread):
-    """Thread for reading serial data"""
-    data_received = pyqtSignal(str)
+    """Thread for reading serial data
+
+    Takes whatever has arrived in one read and feeds it to a TelemetryStream, which
+    fills the per sensor histories the GUI redraws from on its own timer. Only text
+    lines and records other than reports come back through signals. The MODES
+    commands are sent on connect and RESTORE_MODE on disconnect.
+    """
+    lines_received = pyqtSignal(list)
+    records_received = pyqtSignal(list)
     
-    def __init__(self, port, baudrate=115200):
+    def __init__(self, port, stream, mode=MODES["Binary delta"], baudrate=115200):
         super().__init__()
         self.port = port
+        self.stream = stream
+        self.mode = mode
         self.baudrate = baudrate
         self.running = False
         self.serial_conn = None
         
     def run(self):
         try:
-            self.serial_conn = serial.Serial(self.port, self.baudrate, timeout=1)
+            self.serial_conn = serial.Serial(self.port, self.baudrate, timeout=READ_TIMEOUT)
             self.running = True
             
-            # Request configuration immediately on connect
+            # Pick the output mode and request configuration immediately on connect
             import time
             time.sleep(0.5)  # Wait for ESP32 to be ready
-            self.serial_conn.write(b"GET_CONFIG\n")
+            self.send_commands(self.mode + [b"GET_CONFIG"])
             
             while self.running:
-                if self.serial_conn.in_waiting:
-                    try:
-                        line = self.serial_conn.readline().decode('utf-8', errors='ignore').strip()
-                        if line:
-                            self.data_received.emit(line)
-                    except Exception as e:
-                        self.data_received.emit(f"Read error: {e}")
+                try:
+                    # Blocks for the first byte then takes the rest of what is buffered
+                    data = self.serial_conn.read(self.serial_conn.in_waiting or 1)
+                    records, lines = self.stream.feed(data)
+                    if records:
+                        self.records_received.emit(records)
+                    if lines:
+                        self.lines_received.emit(lines)
+                except Exception as e:
+                    self.lines_received.emit([f"Read error: {e}"])
+            self.send_commands(RESTORE_MODE)
         except Exception as e:
-            self.data_received.emit(f"Serial error: {e}")
+            self.lines_received.emit([f"Serial error: {e}"])
+        finally:
+            self.running = False
+            if self.serial_conn and self.serial_conn.is_open:
+                self.serial_conn.close()
+
+    def send_commands(self, commands):
+        self.serial_conn.write(b"".join(command + b"\n" for command in commands))
             
     def stop(self):
+        """Ends run() within READ_TIMEOUT, which restores text mode and closes the port"""
         self.running = False
-        if self.serial_conn and self.serial_conn.is_open:
-            self.serial_conn.close()
 
 
 class RadarArcWidget(QWidget):
@@ -156,25 +187,21 @@ class RadarMonitor(QMainWindow):
         super().__init__()
         self.serial_thread = None
         
-        # Data buffers for time plots (120 seconds at ~2 updates/sec = 240 points)
-        self.max_history = 240
-        self.time_data = deque(maxlen=self.max_history)
-        self.detection_stat_data = deque(maxlen=self.max_history)
-        self.detection_mov_data = deque(maxlen=self.max_history)
-        self.photosensitive_data = deque(maxlen=self.max_history)
-        self.start_time = datetime.now()
+        # Per sensor ring buffers, filled by the serial thread
+        self.stream = TelemetryStream()
+        self.drawn_frames = 0  # ReportHistory.frames when the plots were last redrawn
         
         # Current data
-        self.moving_energy = [0] * 9
-        self.stationary_energy = [0] * 9
         self.moving_sensitivity = [0] * 9
         self.stationary_sensitivity = [0] * 9
-        self.current_presence = False
-        self.current_stat_dist = 0
-        self.current_mov_dist = 0
         
         self.init_ui()
         
+        # Redraw at a fixed rate however fast the data comes in
+        self.redraw_timer = QTimer(self)
+        self.redraw_timer.timeout.connect(self.update_displays)
+        self.redraw_timer.start(REDRAW_INTERVAL)
+        
     def init_ui(self):
         self.setWindowTitle('LD2410C Radar Monitor v3')
         self.setGeometry(100, 100, 1400, 900)
@@ -198,6 +225,11 @@ class RadarMonitor(QMainWindow):
         conn_layout.addWidget(QLabel("Port:"))
         conn_layout.addWidget(self.port_combo)
         
+        self.mode_combo = QComboBox()
+        self.mode_combo.addItems(MODES.keys())
+        conn_layout.addWidget(QLabel("Mode:"))
+        conn_layout.addWidget(self.mode_combo)
+        
         self.refresh_btn = QPushButton("Refresh")
         self.refresh_btn.clicked.connect(self.refresh_ports)
         conn_layout.addWidget(self.refresh_btn)
@@ -206,6 +238,11 @@ class RadarMonitor(QMainWindow):
         self.connect_btn.clicked.connect(self.toggle_connection)
         conn_layout.addWidget(self.connect_btn)
         
+        self.sensor_combo = QComboBox()
+        self.sensor_combo.currentIndexChanged.connect(self.select_sensor)
+        conn_layout.addWidget(QLabel("Sensor:"))
+        conn_layout.addWidget(self.sensor_combo)
+        
         conn_layout.addStretch()
         conn_group.setLayout(conn_layout)
         main_layout.addWidget(conn_group)
@@ -267,7 +304,7 @@ class RadarMonitor(QMainWindow):
         self.range_plot.addLegend()
         graphs_layout.addWidget(self.range_plot, 1, 0)
         
-        # 4. Photosensitive value over time (placeholder - will be 0 until we parse it)
+        # 4. Photosensitive value over time, from engineering frames
         self.photo_plot = pg.PlotWidget(title="Photosensitive Value (Last 120s)")
         self.photo_plot.setLabel('left', 'Value', units='')
         self.photo_plot.setLabel('bottom', 'Time', units='s')
@@ -336,22 +373,25 @@ class RadarMonitor(QMainWindow):
             port_text = self.port_combo.currentText()
             if port_text:
                 port = port_text.split(' - ')[0]
-                self.serial_thread = SerialReader(port)
-                self.serial_thread.data_received.connect(self.process_serial_data)
+                self.stream = TelemetryStream()
+                self.sensor_combo.clear()
+                self.serial_thread = SerialReader(port, self.stream, MODES[self.mode_combo.currentText()])
+                self.serial_thread.lines_received.connect(self.process_serial_lines)
+                self.serial_thread.records_received.connect(self.process_records)
                 self.serial_thread.start()
                 self.connect_btn.setText("Disconnect")
                 self.log_text.append(f"Connected to {port}")
-                self.start_time = datetime.now()
         else:
             self.serial_thread.stop()
             self.serial_thread.wait()
             self.connect_btn.setText("Connect")
             self.log_text.append("Disconnected")
             
-    def process_serial_data(self, line):
-        # Only log important lines to avoid spam
-        if any(x in line for x in ["Presence:", "GATES_", "Version:", "Max gate:", "Motion:", "Stationary:"]):
-            self.log_text.append(line)
+    def process_serial_lines(self, lines):
+        # Only log important lines to avoid spam, all of a chunk's in one append
+        logged = [line for line in lines if any(x in line for x in ["Presence:", "GATES_", "Version:", "Max gate:", "Motion:", "Stationary:"])]
+        if logged:
+            self.log_text.append('\n'.join(logged))
             # Auto-scroll and limit
             cursor = self.log_text.textCursor()
             cursor.movePosition(cursor.End)
@@ -360,93 +400,80 @@ class RadarMonitor(QMainWindow):
             # Limit log size
             if self.log_text.document().blockCount() > 500:
                 cursor.movePosition(cursor.Start)
-                cursor.movePosition(cursor.Down, cursor.KeepAnchor, 100)
+                cursor.movePosition(cursor.Down, cursor.KeepAnchor, self.log_text.document().blockCount() - 400)
                 cursor.removeSelectedText()
         
-        # Parse detection data
-        if "Presence:" in line:
-            self.parse_detection(line)
-        
-        # Parse gate energy data
-        if "GATES_MOV:" in line:
-            self.parse_gate_data(line)
-        
-        # Parse sensitivity configuration
-        if "SENSITIVITY_" in line or "Gate" in line or "Sensitivity" in line:
-            self.parse_sensitivity(line)
-            
-    def parse_detection(self, line):
-        # Format: "Presence: YES | Stationary: 38cm E:100 | Moving: 30cm E:100"
-        self.current_presence = 'YES' in line
-        
-        # Parse stationary
-        stat_match = re.search(r'Stationary:\s*(\d+)cm\s*E:(\d+)', line)
-        if stat_match:
-            self.current_stat_dist = int(stat_match.group(1))
-        else:
-            self.current_stat_dist = 0
-            
-        # Parse moving
-        mov_match = re.search(r'Moving:\s*(\d+)cm\s*E:(\d+)', line)
-        if mov_match:
-            self.current_mov_dist = int(mov_match.group(1))
-        else:
-            self.current_mov_dist = 0
-        # Update time plot data
-        elapsed = (datetime.now() - self.start_time).total_seconds()
-        self.time_data.append(elapsed)
-        
-        # Store stationary and moving distances separately
-        self.detection_stat_data.append(self.current_stat_dist)
-        self.detection_mov_data.append(self.current_mov_dist)
-        
-        # Photosensitive placeholder (0 for now)
-        self.photosensitive_data.append(0)
-        
-        self.update_displays()
+        # Presence and gate lines are already in the stream's histories
+        for line in lines:
+            # Parse sensitivity configuration
+            if "SENSITIVITY_" in line or "Gate" in line or "Sensitivity" in line:
+                self.parse_sensitivity(line)
+    
+    def process_records(self, records):
+        # Binary telemetry sends the configuration as a record rather than text
+        for record in records:
+            if record['type'] == RECORD_CONFIG and record['sensor_id'] == self.selected_sensor():
+                self.moving_sensitivity = record['motion_sensitivity']
+                self.stationary_sensitivity = record['stationary_sensitivity']
+                self.update_sensitivity_plots()
+    
+    def selected_sensor(self):
+        sensor_id = self.sensor_combo.currentData()
+        return 0 if sensor_id is None else sensor_id
     
-    def parse_gate_data(self, line):
-        # Format: "GATES_MOV:0,1,2,3,4,5,6,7,8 | GATES_STAT:0,1,2,3,4,5,6,7,8"
-        mov_match = re.search(r'GATES_MOV:([\d,]+)', line)
-        stat_match = re.search(r'GATES_STAT:([\d,]+)', line)
-        
-        if mov_match:
-            mov_values = [int(x) for x in mov_match.group(1).split(',')]
-            if len(mov_values) == 9:
-                self.moving_energy = mov_values
-                
-        if stat_match:
-            stat_values = [int(x) for x in stat_match.group(1).split(',')]
-            if len(stat_values) == 9:
-                self.stationary_energy = stat_values
-        
-        self.update_gate_plots()
+    def select_sensor(self):
+        self.drawn_frames = -1  # Redraw even if the new sensor has as many frames as the old one
         
     def update_displays(self):
+        # Offer every sensor that has sent a report
+        for sensor_id in self.stream.sensors():
+            if self.sensor_combo.findData(sensor_id) < 0:
+                self.sensor_combo.addItem(f"S{sensor_id}", sensor_id)
+        
+        history = self.stream.history.get(self.selected_sensor())
+        if history is None or history.frames == self.drawn_frames:
+            return
+        self.drawn_frames = history.frames
+        rows = history.snapshot(HISTORY_SECONDS)
+        if len(rows) == 0:
+            return
+        
+        # Distances only count while that kind of target is detected
+        stat_dist = np.where(rows['target_type'] & 0x02, rows['stationary_distance'], 0)
+        mov_dist = np.where(rows['target_type'] & 0x01, rows['moving_distance'], 0)
+        current_presence = bool(rows['target_type'][-1] != 0)
+        current_stat_dist = int(stat_dist[-1])
+        current_mov_dist = int(mov_dist[-1])
+        
         # Update radar arc
-        self.radar_arc.update_data(self.current_presence, self.current_stat_dist, self.current_mov_dist)
+        self.radar_arc.update_data(current_presence, current_stat_dist, current_mov_dist)
         
         # Update status labels
-        if self.current_presence:
+        if current_presence:
             self.presence_label.setText("TARGET DETECTED")
             self.presence_label.setStyleSheet("font-size: 14pt; font-weight: bold; color: #00ff00;")
         else:
             self.presence_label.setText("NO TARGET")
             self.presence_label.setStyleSheet("font-size: 14pt; font-weight: bold; color: gray;")
         
-        self.stat_label.setText(f"{self.current_stat_dist} cm" if self.current_stat_dist > 0 else "--")
-        self.mov_label.setText(f"{self.current_mov_dist} cm" if self.current_mov_dist > 0 else "--")
+        self.stat_label.setText(f"{current_stat_dist} cm" if current_stat_dist > 0 else "--")
+        self.mov_label.setText(f"{current_mov_dist} cm" if current_mov_dist > 0 else "--")
         
         # Update time plots
-        if len(self.time_data) > 0:
-            times = np.array(self.time_data)
-            
-            # Detection range plot (separate curves for stationary and moving)
-            self.range_stat_curve.setData(times, np.array(self.detection_stat_data))
-            self.range_mov_curve.setData(times, np.array(self.detection_mov_data))
-            
-            # Photosensitive plot
-            self.photo_curve.setData(times, self.photosensitive_data)
+        times = rows['time']
+        
+        # Detection range plot (separate curves for stationary and moving)
+        self.range_stat_curve.setData(times, stat_dist)
+        self.range_mov_curve.setData(times, mov_dist)
+        
+        # Photosensitive plot, basic frames don't carry the light level so only engineering ones
+        engineering = np.flatnonzero(rows['flags'] & FLAG_ENGINEERING)
+        self.photo_curve.setData(times[engineering], rows['light_level'][engineering])
+        
+        # Gate energies from the newest engineering frame
+        if len(engineering) > 0:
+            latest = rows[engineering[-1]]
+            self.update_gate_plots(latest['moving_gate_energy'], latest['stationary_gate_energy'])
             
     def parse_sensitivity(self, line):
         # Parse new format: "SENSITIVITY_MOTION:0:36" or "SENSITIVITY_STATIC:0:0"
@@ -505,13 +532,13 @@ class RadarMonitor(QMainWindow):
         # Update stationary sensitivity baseline (gray dashed line)
         self.static_sensitivity_curve.setData(x, self.stationary_sensitivity)
     
-    def update_gate_plots(self):
+    def update_gate_plots(self, moving_energy, stationary_energy):
         # X-axis: gate distances
         x = np.array([i * 75 for i in range(9)])
         
         # Update real-time energy (colored solid lines)
-        self.moving_energy_curve.setData(x, self.moving_energy)
-        self.static_energy_curve.setData(x, self.stationary_energy)
+        self.moving_energy_curve.setData(x, moving_energy)
+        self.static_energy_curve.setData(x, stationary_energy)
         
     def closeEvent(self, event):
         if self.serial_thread and self.serial_thread.running:
@@ -0,0 +1,530 @@
+"""
+Decoder for the binary telemetry stream sent by the ESP32 firmware
+Records are COBS framed and 0x00 delimited, layouts match src/telemetry.h
+"""
+
+import binascii
+import re
+import struct
+import threading
+import time
+
+import numpy as np
+
+TELEMETRY_VERSION = 4
+RECORD_REPORT = 0x01
+RECORD_CONFIG = 0x02
+RECORD_PRESENCE = 0x03
+RECORD_DELTA = 0x04
+RECORD_SUMMARY = 0x05
+RECORD_STATS = 0x06
+FLAG_ENGINEERING = 0x01
+FLAG_FUSED_PRESENCE = 0x02
+FLAG_OUT_PIN = 0x04  # Engineering frames only
+
+# Delta record change mask, bits 0-8 moving gates, 9-17 stationary gates
+DELTA_TARGET_TYPE = 1 << 18
+DELTA_MOVING = 1 << 19
+DELTA_STATIONARY = 1 << 20
+DELTA_LIGHT = 1 << 21
+DELTA_TIME_UNIT = 100  # us per count of time_offset
+
+# type, version, sensor id, sequence, timestamp (us), flags, target type, moving dist/energy, stationary dist/energy, 9+9 gate energies, light level
+REPORT_STRUCT = struct.Struct('<BBBIIBBHBHB9B9BB')
+# type, version, sensor id, max gate, max moving gate, max stationary gate, idle time, 9+9 sensitivities
+CONFIG_STRUCT = struct.Struct('<BBBBBBH9B9B')
+# type, version, sensor id, sequence, timestamp (us), present, target type, nearest distance
+PRESENCE_STRUCT = struct.Struct('<BBBIIBBH')
+# type, version, sensor id, sequence offset, time offset, 24 bit change mask, then the changes
+DELTA_HEADER_STRUCT = struct.Struct('<BBBBH3s')
+# type, version, sensor id, frames, window (ms), then per gate (moving 0-8, stationary 0-8) mean, average, min, max, variance
+SUMMARY_STRUCT = struct.Struct('<BBBHI18B18B18B18B18H')
+# type, version, sensor id, then the counters in STATS_FIELDS order
+STATS_STRUCT = struct.Struct('<BBBIIIH12I')
+STATS_FIELDS = (
+    'bytes_received', 'bytes_discarded', 'receive_overflow_bytes', 'uart_high_water',
+    'data_frames', 'ack_frames', 'unknown_frames', 'length_mismatches', 'frame_overruns',
+    'commands_sent', 'command_timeouts', 'reports_dropped',
+    'parse_passes', 'parse_cycles_min', 'parse_cycles_average', 'parse_cycles_max',
+)
+
+# Same layout as REPORT_STRUCT, for decoding many reports at once with np.frombuffer
+REPORT_DTYPE = np.dtype([
+    ('type', 'u1'),
+    ('version', 'u1'),
+    ('sensor_id', 'u1'),
+    ('sequence', '<u4'),
+    ('timestamp', '<u4'),
+    ('flags', 'u1'),
+    ('target_type', 'u1'),
+    ('moving_distance', '<u2'),
+    ('moving_energy', 'u1'),
+    ('stationary_distance', '<u2'),
+    ('stationary_energy', 'u1'),
+    ('moving_gate_energy', 'u1', (9,)),
+    ('stationary_gate_energy', 'u1', (9,)),
+    ('light_level', 'u1'),
+])
+assert REPORT_DTYPE.itemsize == REPORT_STRUCT.size
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as telemetryCrc16() in the firmware"""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def cobs_decode(data):
+    """Decode one COBS frame (without its 0x00 delimiter), returns None if malformed"""
+    out = bytearray()
+    i = 0
+    end = len(data)
+    while i < end:
+        code = data[i]
+        if code == 0 or i + code > end:
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < end:
+            out.append(0)
+    return bytes(out)
+
+
+def decode_payload(frame):
+    """Undo the COBS framing of one frame and check its CRC and version, returns the record bytes or None"""
+    raw = cobs_decode(frame)
+    if raw is None or len(raw) < 4:
+        return None
+    payload, crc = raw[:-2], raw[-2] | (raw[-1] << 8)
+    if crc16(payload) != crc or payload[1] != TELEMETRY_VERSION:
+        return None
+    return payload
+
+
+def decode_record(frame):
+    """Check and unpack one COBS frame, returns a dict or None if it is not a valid record"""
+    payload = decode_payload(frame)
+    if payload is None:
+        return None
+    return unpack_record(payload)
+
+
+def unpack_record(payload):
+    """Unpack the bytes of a checked record, returns a dict or None if its type or length is unknown"""
+    if payload[0] == RECORD_REPORT and len(payload) == REPORT_STRUCT.size:
+        fields = REPORT_STRUCT.unpack(payload)
+        return {
+            'type': RECORD_REPORT,
+            'sensor_id': fields[2],
+            'sequence': fields[3],
+            'timestamp': fields[4],
+            'flags': fields[5],
+            'engineering': bool(fields[5] & FLAG_ENGINEERING),
+            'fused_presence': bool(fields[5] & FLAG_FUSED_PRESENCE),
+            'out_pin': bool(fields[5] & FLAG_OUT_PIN),
+            'target_type': fields[6],
+            'moving_distance': fields[7],
+            'moving_energy': fields[8],
+            'stationary_distance': fields[9],
+            'stationary_energy': fields[10],
+            'moving_gate_energy': list(fields[11:20]),
+            'stationary_gate_energy': list(fields[20:29]),
+            'light_level': fields[29],
+        }
+    if payload[0] == RECORD_CONFIG and len(payload) == CONFIG_STRUCT.size:
+        fields = CONFIG_STRUCT.unpack(payload)
+        return {
+            'type': RECORD_CONFIG,
+            'sensor_id': fields[2],
+            'max_gate': fields[3],
+            'max_moving_gate': fields[4],
+            'max_stationary_gate': fields[5],
+            'idle_time': fields[6],
+            'motion_sensitivity': list(fields[7:16]),
+            'stationary_sensitivity': list(fields[16:25]),
+        }
+    if payload[0] == RECORD_PRESENCE and len(payload) == PRESENCE_STRUCT.size:
+        fields = PRESENCE_STRUCT.unpack(payload)
+        return {
+            'type': RECORD_PRESENCE,
+            'sensor_id': fields[2],
+            'sequence': fields[3],
+            'timestamp': fields[4],
+            'present': bool(fields[5]),
+            'target_type': fields[6],
+            'distance': fields[7],
+        }
+    if payload[0] == RECORD_SUMMARY and len(payload) == SUMMARY_STRUCT.size:
+        fields = SUMMARY_STRUCT.unpack(payload)
+        return {
+            'type': RECORD_SUMMARY,
+            'sensor_id': fields[2],
+            'frames': fields[3],
+            'window_ms': fields[4],
+            'mean': list(fields[5:23]),
+            'average': list(fields[23:41]),
+            'minimum': list(fields[41:59]),
+            'maximum': list(fields[59:77]),
+            'variance': list(fields[77:95]),
+        }
+    if payload[0] == RECORD_STATS and len(payload) == STATS_STRUCT.size:
+        fields = STATS_STRUCT.unpack(payload)
+        record = {'type': RECORD_STATS, 'sensor_id': fields[2]}
+        record.update(zip(STATS_FIELDS, fields[3:]))
+        return record
+    if payload[0] == RECORD_DELTA and len(payload) >= DELTA_HEADER_STRUCT.size:
+        fields = DELTA_HEADER_STRUCT.unpack_from(payload)
+        return {
+            'type': RECORD_DELTA,
+            'sensor_id': fields[2],
+            'sequence_offset': fields[3],
+            'time_offset': fields[4],
+            'mask': int.from_bytes(fields[5], 'little'),
+            'changes': payload[DELTA_HEADER_STRUCT.size:],
+        }
+    return None
+
+
+def pack_report(report):
+    """Inverse of unpacking a RECORD_REPORT, None if a field is out of range"""
+    try:
+        return REPORT_STRUCT.pack(
+            RECORD_REPORT, TELEMETRY_VERSION, report['sensor_id'], report['sequence'] & 0xFFFFFFFF,
+            report['timestamp'], report['flags'], report['target_type'],
+            report['moving_distance'], report['moving_energy'],
+            report['stationary_distance'], report['stationary_energy'],
+            *report['moving_gate_energy'], *report['stationary_gate_energy'], report['light_level'])
+    except struct.error:
+        return None
+
+
+def apply_delta(report, delta):
+    """Rebuild the next report from the previous one and a delta record, None if the delta is malformed"""
+    changes = delta['changes']
+    pos = 0
+    moving = list(report['moving_gate_energy'])
+    stationary = list(report['stationary_gate_energy'])
+    flags = report['flags']
+    target_type = report['target_type']
+    moving_distance, moving_energy = report['moving_distance'], report['moving_energy']
+    stationary_distance, stationary_energy = report['stationary_distance'], report['stationary_energy']
+    light_level = report['light_level']
+    try:
+        for gate in range(18):
+            if delta['mask'] & (1 << gate):
+                change = struct.unpack_from('<b', changes, pos)[0]
+                pos += 1
+                if gate < 9:
+                    moving[gate] += change
+                else:
+                    stationary[gate - 9] += change
+        if delta['mask'] & DELTA_TARGET_TYPE:
+            flags, target_type = struct.unpack_from('<BB', changes, pos)
+            pos += 2
+        if delta['mask'] & DELTA_MOVING:
+            moving_distance, moving_energy = struct.unpack_from('<HB', changes, pos)
+            pos += 3
+        if delta['mask'] & DELTA_STATIONARY:
+            stationary_distance, stationary_energy = struct.unpack_from('<HB', changes, pos)
+            pos += 3
+        if delta['mask'] & DELTA_LIGHT:
+            light_level = struct.unpack_from('<B', changes, pos)[0]
+            pos += 1
+    except struct.error:
+        return None
+    if pos != len(changes):
+        return None
+    return {
+        'type': RECORD_REPORT,
+        'sensor_id': report['sensor_id'],
+        'sequence': report['key_sequence'] + delta['sequence_offset'],
+        'timestamp': (report['key_timestamp'] + delta['time_offset'] * DELTA_TIME_UNIT) & 0xFFFFFFFF,
+        'flags': flags,
+        'engineering': bool(flags & FLAG_ENGINEERING),
+        'fused_presence': bool(flags & FLAG_FUSED_PRESENCE),
+        'out_pin': bool(flags & FLAG_OUT_PIN),
+        'target_type': target_type,
+        'moving_distance': moving_distance,
+        'moving_energy': moving_energy,
+        'stationary_distance': stationary_distance,
+        'stationary_energy': stationary_energy,
+        'moving_gate_energy': moving,
+        'stationary_gate_energy': stationary,
+        'light_level': light_level,
+        'key_sequence': report['key_sequence'],
+        'key_timestamp': report['key_timestamp'],
+        'delta': True,
+    }
+
+
+class TelemetryDecoder:
+    """Splits a byte stream on 0x00 delimiters and yields decoded records
+
+    Delta records are expanded back into full RECORD_REPORT dicts, so callers
+    see the same records whether or not the firmware is delta encoding.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.bad_frames = 0
+        self.lost_deltas = 0  # Deltas dropped because an earlier record went missing, until the next keyframe
+        self.reports = {}     # Latest reconstructed report per sensor id
+
+    def feed(self, data):
+        self.buffer += data
+        *frames, tail = self.buffer.split(b'\x00')
+        self.buffer = tail
+        records = []
+        for frame in frames:
+            if not frame:
+                continue
+            record = decode_record(frame)
+            if record is None:
+                # Text (e.g. library debug output) or line noise between records
+                self.bad_frames += 1
+            elif record['type'] == RECORD_DELTA:
+                record = self.expand_delta(record)
+                if record is not None:
+                    records.append(record)
+            else:
+                if record['type'] == RECORD_REPORT:
+                    self.add_keyframe(record)
+                records.append(record)
+        return records
+
+    def add_keyframe(self, report):
+        """Every full report is a keyframe for the deltas that follow it"""
+        report['key_sequence'] = report['sequence']
+        report['key_timestamp'] = report['timestamp']
+        self.reports[report['sensor_id']] = report
+
+    def expand_delta(self, delta):
+        """Rebuild the report a delta record stands for, None if it can't be"""
+        previous = self.reports.get(delta['sensor_id'])
+        # Every frame gets a record, so a jump in the offset means one was lost and the state is stale
+        if previous is None or delta['sequence_offset'] != previous['sequence'] - previous['key_sequence'] + 1:
+            self.reports.pop(delta['sensor_id'], None)
+            self.lost_deltas += 1
+            return None
+        report = apply_delta(previous, delta)
+        if report is None:
+            self.reports.pop(delta['sensor_id'], None)
+            self.bad_frames += 1
+            return None
+        self.reports[delta['sensor_id']] = report
+        return report
+
+
+HISTORY_CAPACITY = 4096  # Reports kept per sensor, a few minutes at the radar's full frame rate
+TEXT_FALLBACK = 1024     # Bytes without a 0x00 before a binary stream is taken to have gone back to text (BINARY_OFF)
+
+# One row of a ReportHistory, the report fields a monitor plots plus when the report arrived
+HISTORY_DTYPE = np.dtype([
+    ('time', '<f8'),  # s since the TelemetryStream started
+    ('flags', 'u1'),
+    ('target_type', 'u1'),
+    ('moving_distance', '<u2'),
+    ('moving_energy', 'u1'),
+    ('stationary_distance', '<u2'),
+    ('stationary_energy', 'u1'),
+    ('moving_gate_energy', 'u1', (9,)),
+    ('stationary_gate_energy', 'u1', (9,)),
+    ('light_level', 'u1'),
+])
+HISTORY_FIELDS = HISTORY_DTYPE.names[1:]
+
+# A report printed by the firmware in text mode, with the gate line that follows it in engineering mode
+TEXT_REPORT = re.compile(
+    rb'^(?:S(\d+) )?Presence: (YES|NO)'
+    rb'(?: \| Stationary: (\d+)cm E:(\d+))?(?: \| Moving: (\d+)cm E:(\d+))?\r?$'
+    rb'(?:\n(?:GATES_MOV:((?:\d+,){8}\d+) \| GATES_STAT:((?:\d+,){8}\d+))(?: \| LIGHT:(\d+) \| OUT:([01]))?\r?$)?',
+    re.M)
+NO_GATES = b','.join([b'0'] * 9)
+
+
+def _text_column(values, dtype):
+    """Numbers captured by TEXT_REPORT as an array, missing ones are 0"""
+    return np.array([value or b'0' for value in values]).astype(dtype)
+
+
+def _text_gates(values):
+    """Comma separated gate energies captured by TEXT_REPORT as an (n, 9) array"""
+    return np.array(b','.join(value or NO_GATES for value in values).split(b',')).astype(np.uint8).reshape(-1, 9)
+
+
+class RingBuffer:
+    """Fixed size history in a preallocated numpy array
+
+    Every row is stored twice, capacity apart, so the newest rows are always one
+    contiguous slice and view() never has to copy or reorder them.
+    """
+
+    def __init__(self, capacity, dtype):
+        self.capacity = capacity
+        self.data = np.zeros(2 * capacity, dtype)
+        self.head = 0   # Where the next row goes, 0 to capacity - 1
+        self.count = 0
+
+    def __len__(self):
+        return self.count
+
+    def extend(self, rows):
+        rows = rows[-self.capacity:]
+        if len(rows) == 0:
+            return
+        index = (self.head + np.arange(len(rows))) % self.capacity
+        self.data[index] = rows
+        self.data[index + self.capacity] = rows
+        self.head = (self.head + len(rows)) % self.capacity
+        self.count = min(self.count + len(rows), self.capacity)
+
+    def view(self):
+        """Oldest to newest, a view into the buffer that the next extend() overwrites"""
+        end = self.head + self.capacity
+        return self.data[end - self.count:end]
+
+
+class ReportHistory:
+    """Reports from one sensor, added by a TelemetryStream and read from another thread with snapshot()"""
+
+    def __init__(self, capacity=HISTORY_CAPACITY):
+        self.rows = RingBuffer(capacity, HISTORY_DTYPE)
+        self.lock = threading.Lock()
+        self.frames = 0      # Reports ever added, a caller can skip redrawing when it hasn't moved
+        self.last_time = 0.0
+
+    def add_reports(self, reports, now):
+        """Append an array of REPORT_DTYPE records that arrived by now
+
+        Their device timestamps keep the spacing between reports that came in one
+        chunk, the newest one is placed at now so the clocks can't drift apart.
+        """
+        ages = (reports['timestamp'][-1].astype(np.int64) - reports['timestamp'].astype(np.int64)) & 0xFFFFFFFF
+        rows = np.empty(len(reports), HISTORY_DTYPE)
+        rows['time'] = np.maximum(now - ages * 1e-6, self.last_time)
+        for name in HISTORY_FIELDS:
+            rows[name] = reports[name]
+        self.add_rows(rows)
+
+    def add_rows(self, rows):
+        with self.lock:
+            self.rows.extend(rows)
+            self.frames += len(rows)
+            self.last_time = rows['time'][-1]
+
+    def snapshot(self, seconds=None):
+        """Copy of the newest rows, all of them or those from the last seconds"""
+        with self.lock:
+            rows = self.rows.view()
+            if seconds is not None and len(rows) > 0:
+                rows = rows[np.searchsorted(rows['time'], rows['time'][-1] - seconds):]
+            return rows.copy()
+
+
+class TelemetryStream:
+    """Turns chunks of serial data, binary records or the firmware's text, into a ReportHistory per sensor
+
+    Reports are collected over a whole chunk and written with one np.frombuffer and
+    one ring buffer copy per sensor, text reports with one regex pass, so the cost
+    per frame stays small with several radars at full rate. Other records and
+    every complete text line are returned to the caller.
+    """
+
+    def __init__(self, capacity=HISTORY_CAPACITY):
+        self.capacity = capacity
+        self.decoder = TelemetryDecoder()
+        self.history = {}       # Sensor id -> ReportHistory
+        self.buffer = bytearray()
+        self.text = bytearray()
+        self.binary = False     # A valid record has been seen since the stream last looked like text
+        self.keyframes = {}     # Newest full report per sensor, only unpacked when a delta needs it
+        self.start = time.monotonic()
+
+    def sensor(self, sensor_id):
+        history = self.history.get(sensor_id)
+        if history is None:
+            history = self.history[sensor_id] = ReportHistory(self.capacity)
+        return history
+
+    def sensors(self):
+        return sorted(list(self.history))
+
+    def feed(self, data, now=None):
+        """Process one chunk, returns the records other than reports and the complete text lines"""
+        if now is None:
+            now = time.monotonic() - self.start
+        self.buffer += data
+        *frames, tail = self.buffer.split(b'\x00')
+        text_length = len(self.text)
+        reports = []
+        records = []
+        for frame in frames:
+            if not frame:
+                continue
+            payload = decode_payload(frame)
+            if payload is None:
+                # Text (e.g. library debug output) or line noise between records
+                self.decoder.bad_frames += 1
+                self.text += frame
+                continue
+            self.binary = True
+            if payload[0] == RECORD_REPORT and len(payload) == REPORT_STRUCT.size:
+                self.keyframes[payload[2]] = payload
+                reports.append(payload)
+                continue
+            record = unpack_record(payload)
+            if record is None:
+                self.decoder.bad_frames += 1
+            elif record['type'] == RECORD_DELTA:
+                keyframe = self.keyframes.pop(record['sensor_id'], None)
+                if keyframe is not None:
+                    self.decoder.add_keyframe(unpack_record(keyframe))
+                report = self.decoder.expand_delta(record)
+                report = pack_report(report) if report is not None else None
+                if report is not None:
+                    reports.append(report)
+            else:
+                records.append(record)
+        if self.binary and len(tail) > TEXT_FALLBACK:
+            self.binary = False
+        if not self.binary and not frames:
+            # Nothing here is part of a record, so every complete line can go
+            end = tail.rfind(b'\n') + 1
+            self.text += tail[:end]
+            del tail[:end]
+        self.buffer = tail
+        if reports:
+            reports = np.frombuffer(b''.join(reports), REPORT_DTYPE)
+            for sensor_id in np.unique(reports['sensor_id']):
+                self.sensor(int(sensor_id)).add_reports(reports[reports['sensor_id'] == sensor_id], now)
+        return records, self._text_lines(now, len(self.text) > text_length)
+
+    def _text_lines(self, now, more):
+        end = self.text.rfind(b'\n') + 1
+        start = self.text.rfind(b'\n', 0, max(end - 1, 0)) + 1
+        if more and b'Presence: ' in self.text[start:end]:
+            # Its GATES_ line may still be on the way, keep it until a chunk brings no more text
+            end = start
+        if end == 0:
+            return []
+        block = bytes(self.text[:end])
+        del self.text[:end]
+        matches = TEXT_REPORT.findall(block)
+        if matches:
+            sensor_ids, presence, stationary_distance, stationary_energy, moving_distance, moving_energy, moving_gates, stationary_gates, light_level, out_pin = zip(*matches)
+            rows = np.zeros(len(matches), HISTORY_DTYPE)
+            rows['time'] = now
+            rows['flags'] = [(FLAG_ENGINEERING if gates else 0) | (FLAG_OUT_PIN if out == b'1' else 0) for gates, out in zip(moving_gates, out_pin)]
+            rows['moving_distance'] = _text_column(moving_distance, np.uint16)
+            rows['moving_energy'] = _text_column(moving_energy, np.uint8)
+            rows['stationary_distance'] = _text_column(stationary_distance, np.uint16)
+            # Text only shows the distance of a detected target, a YES with neither could be either
+            target_type = (rows['moving_distance'] > 0) * 1 | (rows['stationary_distance'] > 0) * 2
+            rows['target_type'] = np.where((np.array(presence) == b'YES') & (target_type == 0), 3, target_type)
+            rows['stationary_energy'] = _text_column(stationary_energy, np.uint8)
+            rows['moving_gate_energy'] = _text_gates(moving_gates)
+            rows['stationary_gate_energy'] = _text_gates(stationary_gates)
+            rows['light_level'] = _text_column(light_level, np.uint8)
+            sensor_ids = _text_column(sensor_ids, np.uint8)
+            for sensor_id in np.unique(sensor_ids):
+                self.sensor(int(sensor_id)).add_rows(rows[sensor_ids == sensor_id])
+        return [line.strip() for line in block.decode('utf-8', errors='ignore').split('\n') if line.strip()]
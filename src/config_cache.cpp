@@ -0,0 +1,89 @@
+#include "config_cache.h"
+#include <Preferences.h>
+
+#define CONFIG_CACHE_KEY_LENGTH 10  // "radar255" and the terminator
+
+struct CachedConfiguration {
+  uint8_t version;                  // CONFIG_CACHE_VERSION
+  ld2410_configuration configuration;
+  uint32_t hash;                    // configurationHash() of the above
+};
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for(size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+// Field by field so struct padding never counts
+static uint32_t configurationHash(const ld2410_configuration &configuration) {
+  uint32_t hash = 2166136261UL;
+  uint8_t version = CONFIG_CACHE_VERSION;
+  hash = fnv1a(hash, &version, sizeof(version));
+  hash = fnv1a(hash, &configuration.firmware_major_version, sizeof(configuration.firmware_major_version));
+  hash = fnv1a(hash, &configuration.firmware_minor_version, sizeof(configuration.firmware_minor_version));
+  hash = fnv1a(hash, &configuration.firmware_bugfix_version, sizeof(configuration.firmware_bugfix_version));
+  hash = fnv1a(hash, &configuration.max_gate, sizeof(configuration.max_gate));
+  hash = fnv1a(hash, &configuration.max_moving_gate, sizeof(configuration.max_moving_gate));
+  hash = fnv1a(hash, &configuration.max_stationary_gate, sizeof(configuration.max_stationary_gate));
+  hash = fnv1a(hash, &configuration.sensor_idle_time, sizeof(configuration.sensor_idle_time));
+  hash = fnv1a(hash, configuration.motion_sensitivity, sizeof(configuration.motion_sensitivity));
+  hash = fnv1a(hash, configuration.stationary_sensitivity, sizeof(configuration.stationary_sensitivity));
+  return hash;
+}
+
+static void cacheKey(char *key, uint8_t sensorId) {
+  snprintf(key, CONFIG_CACHE_KEY_LENGTH, "radar%u", sensorId);
+}
+
+static bool readEntry(uint8_t sensorId, CachedConfiguration &entry) {
+  char key[CONFIG_CACHE_KEY_LENGTH];
+  cacheKey(key, sensorId);
+  Preferences preferences;
+  if(!preferences.begin(CONFIG_CACHE_NAMESPACE, true)) {
+    return false;  // Nothing has been saved yet
+  }
+  size_t length = preferences.getBytes(key, &entry, sizeof(entry));
+  preferences.end();
+  return length == sizeof(entry) && entry.version == CONFIG_CACHE_VERSION &&
+         entry.hash == configurationHash(entry.configuration);
+}
+
+bool loadCachedConfiguration(ld2410 &radar, uint8_t sensorId) {
+  CachedConfiguration entry;
+  if(!readEntry(sensorId, entry)) {
+    return false;
+  }
+  // begin() has just read the firmware version, a different one means a different or updated radar
+  if(entry.configuration.firmware_major_version != radar.firmware_major_version ||
+     entry.configuration.firmware_minor_version != radar.firmware_minor_version ||
+     entry.configuration.firmware_bugfix_version != radar.firmware_bugfix_version) {
+    return false;
+  }
+  radar.restoreConfiguration(entry.configuration);
+  return true;
+}
+
+bool saveCachedConfiguration(ld2410 &radar, uint8_t sensorId) {
+  CachedConfiguration entry = {};
+  entry.version = CONFIG_CACHE_VERSION;
+  if(!radar.getConfiguration(entry.configuration)) {
+    return false;
+  }
+  entry.hash = configurationHash(entry.configuration);
+  CachedConfiguration saved;
+  if(readEntry(sensorId, saved) && saved.hash == entry.hash) {
+    return true;  // Spare the flash, nothing changed
+  }
+  char key[CONFIG_CACHE_KEY_LENGTH];
+  cacheKey(key, sensorId);
+  Preferences preferences;
+  if(!preferences.begin(CONFIG_CACHE_NAMESPACE, false)) {
+    return false;
+  }
+  bool written = preferences.putBytes(key, &entry, sizeof(entry)) == sizeof(entry);
+  preferences.end();
+  return written;
+}
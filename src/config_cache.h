@@ -0,0 +1,25 @@
+/*
+ * Radar configuration kept in NVS so a reboot doesn't have to read it back
+ *
+ * One entry per sensorId in the "ld2410" Preferences namespace. Each entry
+ * is the ld2410_configuration plus an FNV-1a hash of its fields, so a
+ * torn or stale-layout entry is treated as missing rather than restored.
+ * The radar keeps its own configuration in flash, so the cache is only
+ * refreshed after the host reads or changes it.
+ */
+
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H
+
+#include <Arduino.h>
+#include <ld2410.h>
+
+#define CONFIG_CACHE_NAMESPACE "ld2410"
+#define CONFIG_CACHE_VERSION 1  // Bump when ld2410_configuration changes
+
+// Restore the cached configuration for this sensor if there is a valid one for the firmware it reported
+bool loadCachedConfiguration(ld2410 &radar, uint8_t sensorId);
+// Save the radar's configuration, only writing flash if it differs from the entry already there
+bool saveCachedConfiguration(ld2410 &radar, uint8_t sensorId);
+
+#endif
@@ -11,42 +11,119 @@
  * 
  * Note: GPIO 24/25 are not suitable for UART on ESP32-C6
  * Use GPIO 4/5 instead (standard UART pins)
+ *
+ * Set RADAR_COUNT to run more than one LD2410 on this controller, each on
+ * its own hardware UART from radarPorts. A second radar goes on UART0
+ * (LD2410 TX -> GPIO 6, RX -> GPIO 7), which is free because the monitor is
+ * on USB. Text output then starts each line with the sensor number, and
+ * telemetry records carry it as sensorId.
+ * 
+ * Host commands (newline terminated):
+ * GET_CONFIG              - send the sensor configuration
+ * STATS                   - send the parser and command counters of each radar
+ * BINARY_ON / BINARY_OFF  - switch between binary telemetry records (telemetry.h) and text
+ * STREAM_ON / STREAM_OFF  - send a record for every radar frame instead of every 500ms
+ * EVENTS_ON / EVENTS_OFF  - send only presence changes, filtered on the device, instead of samples
+ * DELTA_ON / DELTA_OFF    - binary streaming sends keyframes plus only what changed, see TelemetryDeltaEncoder
+ * SUMMARY_ON / SUMMARY_OFF - send gate statistics every SUMMARY_INTERVAL instead of samples
+ * CALIBRATE[:seconds]     - with the room empty, set every gate threshold just above its noise
+ *                           floor, then send the configuration (CALIBRATION:<id>:<0|1> in text)
+ *
+ * For battery powered installs set POWER_MODE, see power.h. With POWER_OUT_PIN
+ * connect the LD2410 OUT pin to RADAR_OUT_PIN. Sleeping only happens with no
+ * USB host connected. ADAPTIVE_ENGINEERING, on by default with POWER_OUT_PIN,
+ * keeps the radar in basic mode until someone is present, cutting the UART and
+ * telemetry load while the room is empty.
  */
 
 #include <Arduino.h>
 #include <ld2410.h>
+#include <ld2410_manager.h>
+#include "telemetry.h"
+#include "config_cache.h"
+#include "power.h"
 
 #define MONITOR_SERIAL Serial  // USB Serial
 #define RADAR_SERIAL Serial1   // Hardware UART1 on custom pins
 #define RADAR_RX_PIN 4
 #define RADAR_TX_PIN 5
+#define RADAR_BAUD_RATE 460800  // The module ships at 256000, it is moved up to this rate on first boot
+#define RADAR_COUNT 1           // LD2410s on this controller, up to LD2410_MANAGER_MAX_SENSORS
+#define PRESENCE_DEBOUNCE_MS 200   // Targets must last this long to start presence
+#define PRESENCE_HOLD_MS 2000      // and be gone this long to end it
+#define PRESENCE_ON_ENERGY 0       // Energy a target needs to start presence
+#define PRESENCE_OFF_ENERGY 0      // and to keep it going
+#define SUMMARY_INTERVAL 10000     // ms of frames in each gate statistics summary
+#define CONFIG_RETRY_INTERVAL 30000  // ms between attempts to read a configuration that isn't cached
+#define ENGINEERING_RETRY_INTERVAL 1000  // ms between attempts to start engineering mode
+#define ENGINEERING_ATTEMPTS 3
+#define POWER_MODE POWER_ALWAYS_ON  // Or POWER_FRAME_SLEEP / POWER_OUT_PIN to light sleep, see power.h
+#define RADAR_OUT_PIN 3             // LD2410 OUT -> this GPIO, for POWER_OUT_PIN
+#define ADAPTIVE_ENGINEERING (POWER_MODE == POWER_OUT_PIN)  // Basic frames while the room is empty, gate energies only while someone is in it
+#define ADAPTIVE_HOLD_MS 30000      // Engineering mode carries on this long after presence ends
+
+#if POWER_MODE != POWER_ALWAYS_ON && RADAR_COUNT > 1
+#error Light sleep follows the frame timing of a single radar
+#endif
+
+struct RadarPort {
+  HardwareSerial *serial;
+  int8_t rxPin;
+  int8_t txPin;
+};
+
+const RadarPort radarPorts[RADAR_COUNT] = {
+  {&RADAR_SERIAL, RADAR_RX_PIN, RADAR_TX_PIN},
+#if RADAR_COUNT > 1
+  {&Serial0, 6, 7},             // UART0
+#endif
+#if RADAR_COUNT > 2
+  {&Serial2, 16, 17},           // Not on the ESP32-C6, which only has two UARTs
+#endif
+};
 
-ld2410 radar;
+ld2410 radars[RADAR_COUNT];
+ld2410 &radar = radars[0];      // The one text GET_CONFIG reports on
+ld2410_manager radarManager;    // Reads every radar and sends them commands together
+bool lastPresence[RADAR_COUNT];  // Filtered presence of the last frame taken from each radar
+TelemetryDeltaEncoder deltaEncoders[RADAR_COUNT];
 uint32_t lastReading = 0;
 uint32_t lastConfigRead = 0;
-bool configDisplayed = false;
 bool engineeringMode = false;
+uint8_t engineeringAttempts = 0;
+uint32_t lastEngineeringAttempt = 0;
+// Outcomes of async commands, written from the radar task: -1 none yet, 0 failed, 1 succeeded
+volatile int8_t configurationResult[RADAR_COUNT];
+volatile int8_t engineeringResult[RADAR_COUNT];
+bool binaryMode = false;  // Send COBS framed telemetry records instead of text, see telemetry.h
+bool streamMode = false;  // One record per radar frame, batched into large USB writes
+bool eventsMode = false;  // Only presence changes, overrides the sampled and streamed output
+bool deltaMode = false;   // Binary streaming uses deltaEncoders
+bool summaryMode = false; // Gate statistics every SUMMARY_INTERVAL, overrides the sampled and streamed output
+uint32_t lastSummary = 0;
+volatile int8_t calibrationResult[RADAR_COUNT];  // Set from the radar task when a calibration ends, -1 while none has
+TelemetryBatch output(MONITOR_SERIAL);
 
 void printSeparator() {
   MONITOR_SERIAL.println(F("===================================="));
 }
 
-void printConfiguration() {
+void printConfiguration(ld2410 &sensor) {
   printSeparator();
   MONITOR_SERIAL.println(F("SENSOR CONFIGURATION:"));
   printSeparator();
   
   MONITOR_SERIAL.print(F("Max gate: "));
-  MONITOR_SERIAL.println(radar.max_gate);
+  MONITOR_SERIAL.println(sensor.max_gate);
   
   MONITOR_SERIAL.print(F("Max moving gate: "));
-  MONITOR_SERIAL.println(radar.max_moving_gate);
+  MONITOR_SERIAL.println(sensor.max_moving_gate);
   
   MONITOR_SERIAL.print(F("Max stationary gate: "));
-  MONITOR_SERIAL.println(radar.max_stationary_gate);
+  MONITOR_SERIAL.println(sensor.max_stationary_gate);
   
   MONITOR_SERIAL.print(F("Sensor idle time: "));
-  MONITOR_SERIAL.print(radar.sensor_idle_time);
+  MONITOR_SERIAL.print(sensor.sensor_idle_time);
   MONITOR_SERIAL.println(F(" seconds"));
   
   MONITOR_SERIAL.println(F("\nMotion Sensitivity (per gate):"));
@@ -54,7 +131,7 @@ void printConfiguration() {
     MONITOR_SERIAL.print(F("  Gate "));
     MONITOR_SERIAL.print(i);
     MONITOR_SERIAL.print(F(": "));
-    MONITOR_SERIAL.println(radar.motion_sensitivity[i]);
+    MONITOR_SERIAL.println(sensor.motion_sensitivity[i]);
   }
   
   MONITOR_SERIAL.println(F("\nStationary Sensitivity (per gate):"));
@@ -62,54 +139,269 @@ void printConfiguration() {
     MONITOR_SERIAL.print(F("  Gate "));
     MONITOR_SERIAL.print(i);
     MONITOR_SERIAL.print(F(": "));
-    MONITOR_SERIAL.println(radar.stationary_sensitivity[i]);
+    MONITOR_SERIAL.println(sensor.stationary_sensitivity[i]);
   }
   printSeparator();
 }
-void printDetectionInfo() {
-  MONITOR_SERIAL.print(F("Presence: "));
+void printDetectionInfo(Print &out, const ld2410_report &frame, uint8_t sensorId = 0) {
+  if(RADAR_COUNT > 1) {
+    out.print('S');
+    out.print(sensorId);
+    out.print(' ');
+  }
+  out.print(F("Presence: "));
   
-  if(radar.presenceDetected()) {
-    MONITOR_SERIAL.print(F("YES"));
+  if(frame.target_type != 0) {
+    out.print(F("YES"));
     
-    if(radar.stationaryTargetDetected()) {
-      MONITOR_SERIAL.print(F(" | Stationary: "));
-      MONITOR_SERIAL.print(radar.stationaryTargetDistance());
-      MONITOR_SERIAL.print(F("cm E:"));
-      MONITOR_SERIAL.print(radar.stationaryTargetEnergy());
+    if((frame.target_type & 0x02) && frame.stationary_target_distance > 0 && frame.stationary_target_energy > 0) {
+      out.print(F(" | Stationary: "));
+      out.print(frame.stationary_target_distance);
+      out.print(F("cm E:"));
+      out.print(frame.stationary_target_energy);
     }
     
-    if(radar.movingTargetDetected()) {
-      MONITOR_SERIAL.print(F(" | Moving: "));
-      MONITOR_SERIAL.print(radar.movingTargetDistance());
-      MONITOR_SERIAL.print(F("cm E:"));
-      MONITOR_SERIAL.print(radar.movingTargetEnergy());
+    if((frame.target_type & 0x01) && frame.moving_target_distance > 0 && frame.moving_target_energy > 0) {
+      out.print(F(" | Moving: "));
+      out.print(frame.moving_target_distance);
+      out.print(F("cm E:"));
+      out.print(frame.moving_target_energy);
     }
-    MONITOR_SERIAL.println();
+    out.println();
   } else {
-    MONITOR_SERIAL.println(F("NO"));
+    out.println(F("NO"));
   }
   
-  // Print engineering mode gate data if enabled
-  if(engineeringMode) {
-    MONITOR_SERIAL.print(F("GATES_MOV:"));
+  // Print engineering mode gate data if this frame has it
+  if(frame.engineering) {
+    out.print(F("GATES_MOV:"));
     for(int i = 0; i < 9; i++) {
-      MONITOR_SERIAL.print(radar.engineering_moving_energy[i]);
-      if(i < 8) MONITOR_SERIAL.print(F(","));
+      out.print(frame.moving_energy[i]);
+      if(i < 8) out.print(F(","));
     }
-    MONITOR_SERIAL.print(F(" | GATES_STAT:"));
+    out.print(F(" | GATES_STAT:"));
     for(int i = 0; i < 9; i++) {
-      MONITOR_SERIAL.print(radar.engineering_stationary_energy[i]);
-      if(i < 8) MONITOR_SERIAL.print(F(","));
+      out.print(frame.stationary_energy[i]);
+      if(i < 8) out.print(F(","));
+    }
+    out.print(F(" | LIGHT:"));
+    out.print(frame.light_level);
+    out.print(F(" | OUT:"));
+    out.print(frame.out_pin ? 1 : 0);
+    out.println();
+  }
+}
+
+void printPresenceEvent(Print &out, const ld2410_report &frame, uint8_t sensorId) {
+  out.print(F("PRESENCE:"));
+  out.print(sensorId);
+  out.print(':');
+  out.println(frame.presence ? 1 : 0);
+}
+
+void printSummary(Print &out, ld2410_gate_statistics &statistics, uint8_t sensorId) {
+  // SUMMARY:<sensor>:<frames> then mean/average/min/max/variance for each of the 18 gates
+  out.print(F("SUMMARY:"));
+  out.print(sensorId);
+  out.print(':');
+  out.print(statistics.frames());
+  for(uint8_t i = 0; i < LD2410_STATISTICS_GATES; i++) {
+    out.print(i == 0 ? ':' : ';');
+    out.print(statistics.mean(i));
+    out.print(',');
+    out.print(statistics.average(i));
+    out.print(',');
+    out.print(statistics.minimum(i));
+    out.print(',');
+    out.print(statistics.maximum(i));
+    out.print(',');
+    out.print(statistics.variance(i));
+  }
+  out.println();
+}
+
+void sendSummaries() {
+  uint32_t windowMs = millis() - lastSummary;
+  lastSummary = millis();
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    ld2410_gate_statistics statistics;
+    radars[i].takeGateStatistics(statistics);
+    if(binaryMode) {
+      sendTelemetrySummary(output, statistics, windowMs, i);
+    } else {
+      printSummary(output, statistics, i);
+    }
+  }
+}
+
+void printStats(Print &out, ld2410 &sensor, uint8_t sensorId) {
+  ld2410_counters counters;
+  sensor.getCounters(counters);
+  out.print("STATS:");
+  out.print(sensorId);
+  out.print(":bytes=");
+  out.print(counters.bytes_received);
+  out.print(",discarded=");
+  out.print(counters.bytes_discarded);
+  out.print(",overflow=");
+  out.print(counters.receive_overflow_bytes);
+  out.print(",high_water=");
+  out.print(counters.uart_high_water);
+  out.print(",frames=");
+  out.print(counters.data_frames);
+  out.print(",acks=");
+  out.print(counters.ack_frames);
+  out.print(",unknown=");
+  out.print(counters.unknown_frames);
+  out.print(",length_mismatches=");
+  out.print(counters.length_mismatches);
+  out.print(",overruns=");
+  out.print(counters.frame_overruns);
+  out.print(",commands=");
+  out.print(counters.commands_sent);
+  out.print(",timeouts=");
+  out.print(counters.command_timeouts);
+  out.print(",dropped=");
+  out.print(sensor.reportsDropped());
+  out.print(",parse_cycles=");
+  out.print(counters.parse_cycles_min);
+  out.print("/");
+  out.print(counters.parse_passes > 0 ? (uint32_t)(counters.parse_cycles_total / counters.parse_passes) : 0);
+  out.print("/");
+  out.println(counters.parse_cycles_max);
+}
+
+void printPowerStats(Print &out) {
+  PowerStats stats;
+  getPowerStats(stats);
+  out.print("POWER:sleeps=");
+  out.print(stats.sleeps);
+  out.print(",out_pin_sleeps=");
+  out.print(stats.outPinSleeps);
+  out.print(",slept_ms=");
+  out.print((uint32_t)(stats.sleptUs / 1000));
+  out.print(",frame_interval_us=");
+  out.println(stats.frameIntervalUs);
+}
+
+void printDetectionInfo(Print &out) {
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    ld2410_report frame;
+    radars[i].latestReport(frame);
+    printDetectionInfo(out, frame, i);
+  }
+  if(RADAR_COUNT > 1) {
+    out.print(F("Fused presence: "));
+    out.print(radarManager.presenceDetected() ? F("YES") : F("NO"));
+    out.print(F(" | Nearest: "));
+    out.print(radarManager.nearestTargetDistance());
+    out.println(F("cm"));
+  }
+}
+
+void calibrationDone(ld2410 &sensor, bool success, void *context) {
+  (void)sensor;
+  *(volatile int8_t *)context = success ? 1 : 0;  // Runs in the radar task, loop() reports it
+}
+
+void commandDone(ld2410 &sensor, uint8_t handle, uint8_t command, bool success, void *context) {
+  (void)sensor;
+  (void)handle;
+  (void)command;
+  *(volatile int8_t *)context = success ? 1 : 0;
+}
+
+void requestConfiguration(uint8_t i) {
+  configurationResult[i] = -1;
+  if(radars[i].requestCurrentConfigurationAsync(commandDone, (void *)&configurationResult[i]) == 0) {
+    configurationResult[i] = 0;
+  }
+}
+
+void requestEngineeringMode() {
+  engineeringAttempts++;
+  lastEngineeringAttempt = millis();
+  for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+    uint8_t id = radarManager.sensorId(i);
+    engineeringResult[id] = -1;
+    if(radars[id].requestStartEngineeringModeAsync(commandDone, (void *)&engineeringResult[id]) == 0) {
+      engineeringResult[id] = 0;
+    }
+  }
+}
+
+// Follow up the startup commands without holding up detection output
+void serviceStartup() {
+  for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+    uint8_t id = radarManager.sensorId(i);
+    if(configurationResult[id] == 1) {
+      configurationResult[id] = -1;
+      saveCachedConfiguration(radars[id], id);
+      if(!binaryMode) {
+        printConfiguration(radars[id]);
+      }
+    } else if(configurationResult[id] == 0 && millis() - lastConfigRead >= CONFIG_RETRY_INTERVAL) {
+      lastConfigRead = millis();
+      MONITOR_SERIAL.println(F("\nRetrying configuration read..."));
+      requestConfiguration(id);
+    }
+  }
+  if(engineeringMode || engineeringAttempts == 0) {
+    return;
+  }
+  bool waiting = false;
+  bool failed = false;
+  for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+    int8_t result = engineeringResult[radarManager.sensorId(i)];
+    waiting = waiting || result < 0;
+    failed = failed || result == 0;
+  }
+  if(waiting) {
+    return;
+  }
+  if(!failed) {
+    engineeringMode = true;
+    MONITOR_SERIAL.println(F("Engineering mode enabled"));
+  } else if(engineeringAttempts < ENGINEERING_ATTEMPTS) {
+    if(millis() - lastEngineeringAttempt >= ENGINEERING_RETRY_INTERVAL) {
+      requestEngineeringMode();
     }
-    MONITOR_SERIAL.println();
   } else {
-    // Debug: print engineering mode status every 50 reads
-    static int debugCounter = 0;
-    if(++debugCounter >= 50) {
-      MONITOR_SERIAL.println(F("DEBUG: Engineering mode not enabled"));
-      debugCounter = 0;
+    engineeringAttempts = 0;  // Give up
+    MONITOR_SERIAL.println(F("Engineering mode could not be enabled"));
+    MONITOR_SERIAL.println(F("Note: Some LD2410 variants may not support engineering mode"));
+    MONITOR_SERIAL.println(F("Continuing with basic detection mode..."));
+  }
+}
+
+void reportCalibrations() {
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    if(calibrationResult[i] < 0) {
+      continue;
+    }
+    output.flush();
+    if(binaryMode) {
+      sendTelemetryConfig(MONITOR_SERIAL, radars[i], i);
+    } else {
+      MONITOR_SERIAL.print("CALIBRATION:");
+      MONITOR_SERIAL.print(i);
+      MONITOR_SERIAL.print(":");
+      MONITOR_SERIAL.println(calibrationResult[i]);
+      printConfiguration(radars[i]);
+    }
+    if(calibrationResult[i] == 1) {
+      saveCachedConfiguration(radars[i], i);  // The radar saves the new thresholds itself, keep the cache in step
     }
+    calibrationResult[i] = -1;
+    configurationResult[i] = -1;
+    engineeringResult[i] = -1;
+  }
+}
+
+void sendTelemetryReports(Print &out) {
+  uint8_t flags = radarManager.presenceDetected() ? TELEMETRY_FLAG_FUSED_PRESENCE : 0;
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    sendTelemetryReport(out, radars[i], i, flags);
   }
 }
 
@@ -122,143 +414,251 @@ void setup() {
     delay(100);
   #endif
   
-  MONITOR_SERIAL.begin(115200);
-  delay(2000);  // Wait for USB serial to stabilize
-  
-  // Enable debug output from radar library
-  radar.debug(MONITOR_SERIAL);
+  MONITOR_SERIAL.begin(115200);  // No wait for the host, it can ask for the configuration again with GET_CONFIG
   
   printSeparator();
   MONITOR_SERIAL.println(F("ESP32-C6 LD2410C Radar Sensor"));
   printSeparator();
   
-  MONITOR_SERIAL.print(F("Radar TX connected to GPIO "));
-  MONITOR_SERIAL.println(RADAR_RX_PIN);
-  MONITOR_SERIAL.print(F("Radar RX connected to GPIO "));
-  MONITOR_SERIAL.println(RADAR_TX_PIN);
-  MONITOR_SERIAL.println(F("Initializing radar UART..."));
-  
-  // Initialize UART1 for radar (GPIO 24 RX, 25 TX)
-  RADAR_SERIAL.begin(256000, SERIAL_8N1, RADAR_RX_PIN, RADAR_TX_PIN);
-  delay(1000);
-  
-  MONITOR_SERIAL.println(F("UART initialized, connecting to radar..."));
-  
-  MONITOR_SERIAL.print(F("\nInitializing LD2410 radar: "));
-  
-  if(radar.begin(RADAR_SERIAL)) {
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    const RadarPort &port = radarPorts[i];
+    ld2410 &sensor = radars[i];
+    calibrationResult[i] = -1;
+    
+    // Enable debug output from radar library
+    sensor.debug(MONITOR_SERIAL);
+    
+    MONITOR_SERIAL.print(F("Radar "));
+    MONITOR_SERIAL.print(i);
+    MONITOR_SERIAL.print(F(" TX connected to GPIO "));
+    MONITOR_SERIAL.print(port.rxPin);
+    MONITOR_SERIAL.print(F(", RX connected to GPIO "));
+    MONITOR_SERIAL.println(port.txPin);
+    MONITOR_SERIAL.println(F("Initializing radar UART..."));
+    
+    port.serial->begin(RADAR_BAUD_RATE, SERIAL_8N1, port.rxPin, port.txPin);
+    
+    MONITOR_SERIAL.println(F("UART initialized, connecting to radar..."));
+    
+    MONITOR_SERIAL.print(F("\nInitializing LD2410 radar: "));
+    
+    // The library parses the radar UART in its own task, so slow USB output or host commands can't hold it up
+    // If the radar isn't at RADAR_BAUD_RATE yet (e.g. a new module) the library searches for it
+    if(!sensor.begin(*port.serial, true, LD2410_OPTION_RADAR_TASK | LD2410_OPTION_AUTO_BAUD)) {
+      MONITOR_SERIAL.println(F("FAILED - Check connections"));
+      continue;
+    }
     MONITOR_SERIAL.println(F("SUCCESS"));
+    radarManager.addSensor(sensor, i);
+    sensor.setPresenceFilter(PRESENCE_DEBOUNCE_MS, PRESENCE_HOLD_MS, PRESENCE_ON_ENERGY, PRESENCE_OFF_ENERGY);
+    sensor.enableGateStatistics();
+    
+    if(sensor.baudRate() != RADAR_BAUD_RATE) {
+      MONITOR_SERIAL.print(F("Radar found at "));
+      MONITOR_SERIAL.print(sensor.baudRate());
+      MONITOR_SERIAL.print(F(" baud, switching to "));
+      MONITOR_SERIAL.print(RADAR_BAUD_RATE);
+      MONITOR_SERIAL.println(sensor.setBaudRate(RADAR_BAUD_RATE) ? F(" OK") : F(" FAILED"));
+    }
     
     // Display firmware version
     printSeparator();
     MONITOR_SERIAL.println(F("FIRMWARE INFORMATION:"));
     printSeparator();
     MONITOR_SERIAL.print(F("Version: "));
-    MONITOR_SERIAL.print(radar.firmware_major_version);
+    MONITOR_SERIAL.print(sensor.firmware_major_version);
     MONITOR_SERIAL.print('.');
-    MONITOR_SERIAL.print(radar.firmware_minor_version);
+    MONITOR_SERIAL.print(sensor.firmware_minor_version);
     MONITOR_SERIAL.print('.');
-    MONITOR_SERIAL.print(radar.firmware_bugfix_version, HEX);
+    MONITOR_SERIAL.print(sensor.firmware_bugfix_version, HEX);
     MONITOR_SERIAL.println();
-    // Request configuration
-    MONITOR_SERIAL.println(F("\nRequesting configuration..."));
-    if(radar.requestCurrentConfiguration()) {
-      MONITOR_SERIAL.println(F("Configuration read successfully"));
-      delay(500);
-      printConfiguration();
-      configDisplayed = true;
+  }
+  
+  if(radarManager.sensorCount() == 0) {
+    return;
+  }
+  
+  // A configuration saved on an earlier boot for the same firmware saves asking the radar for it
+  for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+    uint8_t id = radarManager.sensorId(i);
+    if(loadCachedConfiguration(radars[id], id)) {
+      configurationResult[id] = -1;  // Nothing to retry, the array starts out as all failures
+      MONITOR_SERIAL.println(F("\nConfiguration restored from NVS"));
+      printConfiguration(radars[id]);
     } else {
-      MONITOR_SERIAL.println(F("Failed to read configuration"));
+      MONITOR_SERIAL.println(F("\nRequesting configuration..."));
+      requestConfiguration(id);
     }
-    
-    // Enable engineering mode with retries
-    MONITOR_SERIAL.println(F("\nEnabling engineering mode..."));
-    delay(1000);  // Wait before engineering mode request
-    
-    // Enable debug for this section
-    radar.debug(MONITOR_SERIAL);
-    
-    bool eng_success = false;
-    for(int attempt = 0; attempt < 3; attempt++) {
-      MONITOR_SERIAL.print(F("Attempt "));
-      MONITOR_SERIAL.print(attempt + 1);
-      MONITOR_SERIAL.print(F("/3... "));
-      MONITOR_SERIAL.flush();
-      
-      if(radar.requestStartEngineeringMode()) {
-        MONITOR_SERIAL.println(F("SUCCESS"));
-        engineeringMode = true;
-        eng_success = true;
-        break;
-      } else {
-        MONITOR_SERIAL.println(F("FAILED"));
-        delay(1000);  // Wait before retry
-      }
-    }
-    
-    if(!eng_success) {
-      MONITOR_SERIAL.println(F("Engineering mode could not be enabled"));
-      MONITOR_SERIAL.println(F("Note: Some LD2410 variants may not support engineering mode"));
-      MONITOR_SERIAL.println(F("Continuing with basic detection mode..."));
+  }
+  
+  beginPower(POWER_MODE, RADAR_RX_PIN, RADAR_OUT_PIN);
+  
+  if(ADAPTIVE_ENGINEERING) {
+    // The library switches engineering mode itself, from the radar task, so no frames are missed waiting on it
+    MONITOR_SERIAL.println(F("\nEngineering mode follows presence"));
+    for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+      radars[radarManager.sensorId(i)].setAdaptiveEngineeringMode(true, ADAPTIVE_HOLD_MS);
     }
-    
-    printSeparator();
-    MONITOR_SERIAL.println(F("REAL-TIME DETECTION DATA:"));
-    MONITOR_SERIAL.println(F("(Updates every 500ms)"));
-    MONITOR_SERIAL.println(F("Format: Presence: YES/NO | Stationary: XXcm E:YY | Moving: XXcm E:YY"));
-    printSeparator();
-    
   } else {
-    MONITOR_SERIAL.println(F("FAILED - Check connections"));
+    // Queued behind any configuration request, loop() retries it if the radar doesn't confirm
+    MONITOR_SERIAL.println(F("\nEnabling engineering mode..."));
+    requestEngineeringMode();
   }
+  
+  printSeparator();
+  MONITOR_SERIAL.println(F("REAL-TIME DETECTION DATA:"));
+  MONITOR_SERIAL.println(F("(Updates every 500ms)"));
+  MONITOR_SERIAL.println(F("Format: Presence: YES/NO | Stationary: XXcm E:YY | Moving: XXcm E:YY"));
+  printSeparator();
 }
 
 void loop() {
-  // Read radar data in a tight loop to prevent UART buffer overflow
-  // Engineering mode frames are 45 bytes and come frequently
-  for(int i = 0; i < 10; i++) {
-    radar.read();
+  // The radar tasks have already parsed the UARTs, this just services any commands when they aren't running
+  radarManager.read();
+  
+  // Every frame parsed is kept in the library's history until taken, so none are skipped
+  // even when a USB write stalls for longer than a frame interval
+  uint8_t flags = radarManager.presenceDetected() ? TELEMETRY_FLAG_FUSED_PRESENCE : 0;
+  for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+    ld2410_report frame;
+    while(radars[i].popReport(frame)) {
+      if(eventsMode) {
+        if(frame.presence != lastPresence[i]) {
+          lastPresence[i] = frame.presence;
+          if(binaryMode) {
+            sendTelemetryPresence(output, frame, i);
+          } else {
+            printPresenceEvent(output, frame, i);
+          }
+        }
+        continue;
+      }
+      lastPresence[i] = frame.presence;
+      if(!streamMode || summaryMode) {
+        continue;
+      }
+      if(binaryMode && deltaMode) {
+        deltaEncoders[i].send(output, frame, i, flags);
+      } else if(binaryMode) {
+        sendTelemetryReport(output, frame, i, flags);
+      } else {
+        printDetectionInfo(output, frame, i);
+      }
+    }
   }
+  if(summaryMode && millis() - lastSummary >= SUMMARY_INTERVAL) {
+    sendSummaries();
+  }
+  serviceStartup();
+  reportCalibrations();
+  output.flushIfDue();
   
   // Check for commands from Python GUI
   if(MONITOR_SERIAL.available()) {
     String cmd = MONITOR_SERIAL.readStringUntil('\n');
     cmd.trim();
+    output.flush();  // Keep replies in order with any batched records
     
     if(cmd == "GET_CONFIG") {
-      // Send configuration in parseable format
-      MONITOR_SERIAL.println("CONFIG_START");
-      for(int i = 0; i < 9; i++) {
-        MONITOR_SERIAL.print("SENSITIVITY_MOTION:");
-        MONITOR_SERIAL.print(i);
-        MONITOR_SERIAL.print(":");
-        MONITOR_SERIAL.println(radar.motion_sensitivity[i]);
+      if(binaryMode) {
+        for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+          sendTelemetryConfig(MONITOR_SERIAL, radars[i], i);
+        }
+      } else {
+        // Send configuration in parseable format
+        MONITOR_SERIAL.println("CONFIG_START");
+        for(int i = 0; i < 9; i++) {
+          MONITOR_SERIAL.print("SENSITIVITY_MOTION:");
+          MONITOR_SERIAL.print(i);
+          MONITOR_SERIAL.print(":");
+          MONITOR_SERIAL.println(radar.motion_sensitivity[i]);
+        }
+        for(int i = 0; i < 9; i++) {
+          MONITOR_SERIAL.print("SENSITIVITY_STATIC:");
+          MONITOR_SERIAL.print(i);
+          MONITOR_SERIAL.print(":");
+          MONITOR_SERIAL.println(radar.stationary_sensitivity[i]);
+        }
+        MONITOR_SERIAL.println("CONFIG_END");
+      }
+    } else if(cmd == "STATS") {
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        if(binaryMode) {
+          sendTelemetryStats(MONITOR_SERIAL, radars[i], i);
+        } else {
+          printStats(MONITOR_SERIAL, radars[i], i);
+        }
       }
-      for(int i = 0; i < 9; i++) {
-        MONITOR_SERIAL.print("SENSITIVITY_STATIC:");
-        MONITOR_SERIAL.print(i);
-        MONITOR_SERIAL.print(":");
-        MONITOR_SERIAL.println(radar.stationary_sensitivity[i]);
+      if(!binaryMode && POWER_MODE != POWER_ALWAYS_ON) {
+        printPowerStats(MONITOR_SERIAL);
+      }
+    } else if(cmd == "BINARY_ON") {
+      binaryMode = true;
+    } else if(cmd == "BINARY_OFF") {
+      binaryMode = false;
+    } else if(cmd == "STREAM_ON") {
+      streamMode = true;
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        deltaEncoders[i].reset();  // The host may have missed the last keyframe
+      }
+    } else if(cmd == "STREAM_OFF") {
+      streamMode = false;
+      output.flush();
+    } else if(cmd == "EVENTS_ON") {
+      eventsMode = true;
+      // Start with the current state so the host doesn't have to wait for a change
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        ld2410_report frame;
+        radars[i].latestReport(frame);
+        if(binaryMode) {
+          sendTelemetryPresence(MONITOR_SERIAL, frame, i);
+        } else {
+          printPresenceEvent(MONITOR_SERIAL, frame, i);
+        }
+      }
+    } else if(cmd == "EVENTS_OFF") {
+      eventsMode = false;
+    } else if(cmd == "DELTA_ON") {
+      deltaMode = true;
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        deltaEncoders[i].reset();
+      }
+    } else if(cmd == "DELTA_OFF") {
+      deltaMode = false;
+    } else if(cmd == "SUMMARY_ON") {
+      summaryMode = true;
+      lastSummary = millis();
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        ld2410_gate_statistics discard;
+        radars[i].takeGateStatistics(discard);  // Start the first window now
+      }
+    } else if(cmd == "SUMMARY_OFF") {
+      summaryMode = false;
+    } else if(cmd.startsWith("CALIBRATE")) {
+      uint32_t duration = LD2410_CALIBRATION_TIME;
+      if(cmd.startsWith("CALIBRATE:")) {
+        duration = cmd.substring(10).toInt() * 1000UL;
+      }
+      for(uint8_t i = 0; i < RADAR_COUNT; i++) {
+        if(!radars[i].startCalibration(duration, LD2410_CALIBRATION_SIGMA, calibrationDone, (void *)&calibrationResult[i])) {
+          calibrationResult[i] = 0;  // Already calibrating or the command queue is full
+        }
       }
-      MONITOR_SERIAL.println("CONFIG_END");
     }
   }
   
-  if(radar.isConnected()) {
-    // Print detection info every 500ms for better responsiveness
-    if(millis() - lastReading > 500) {
+  bool connected = false;
+  for(uint8_t i = 0; i < radarManager.sensorCount(); i++) {
+    connected = connected || radarManager.sensor(i)->isConnected();
+  }
+  if(connected) {
+    // Print detection info every 500ms for better responsiveness, unless every frame is streamed
+    if(!streamMode && !eventsMode && !summaryMode && millis() - lastReading > 500) {
       lastReading = millis();
-      printDetectionInfo();
-    }
-    
-    // Re-request and display config every 30 seconds if not yet displayed
-    if(!configDisplayed && millis() - lastConfigRead > 30000) {
-      lastConfigRead = millis();
-      MONITOR_SERIAL.println(F("\nRetrying configuration read..."));
-      if(radar.requestCurrentConfiguration()) {
-        delay(500);
-        printConfiguration();
-        configDisplayed = true;
+      if(binaryMode) {
+        sendTelemetryReports(MONITOR_SERIAL);
+      } else {
+        printDetectionInfo(MONITOR_SERIAL);
       }
     }
   } else {
@@ -267,4 +667,9 @@ void loop() {
       MONITOR_SERIAL.println(F("Radar disconnected - Check connections"));
     }
   }
+  
+  if(POWER_MODE != POWER_ALWAYS_ON && radarManager.sensorCount() > 0) {
+    output.flush();  // Nothing left waiting in RAM while the CPU sleeps
+    powerSleep(radar, !MONITOR_SERIAL);
+  }
 }
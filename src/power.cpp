@@ -0,0 +1,77 @@
+#include "power.h"
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+
+static uint8_t powerMode = POWER_ALWAYS_ON;
+static int8_t powerRxPin = -1;
+static int8_t powerOutPin = -1;
+static uint32_t lastSequence = 0;
+static uint64_t lastFrameUs = 0;       // Header time of the latest frame
+static PowerStats powerStats = {0, 0, 0, POWER_FRAME_INTERVAL_US};
+
+void beginPower(uint8_t mode, int8_t rxPin, int8_t outPin) {
+  powerMode = mode;
+  powerRxPin = rxPin;
+  powerOutPin = mode == POWER_OUT_PIN ? outPin : -1;
+  if(powerOutPin >= 0) {
+    pinMode(powerOutPin, INPUT);
+  }
+}
+
+bool outPinPresence() {
+  return powerOutPin >= 0 && digitalRead(powerOutPin) == HIGH;
+}
+
+// Follow the radar's frame interval, it differs between firmware and engineering mode
+static void trackFrames(ld2410 &radar) {
+  ld2410_report frame;
+  if(!radar.latestReport(frame) || frame.sequence == lastSequence) {
+    return;
+  }
+  uint64_t interval = frame.timestamp_us - lastFrameUs;
+  if(frame.sequence == lastSequence + 1 && interval < POWER_MAX_FRAME_INTERVAL_US) {
+    powerStats.frameIntervalUs += ((int32_t)interval - (int32_t)powerStats.frameIntervalUs) / 8;
+  }
+  lastSequence = frame.sequence;
+  lastFrameUs = frame.timestamp_us;
+}
+
+static uint64_t lightSleep(uint64_t timeoutUs, int8_t wakePin, gpio_int_type_t level) {
+  uint64_t start = esp_timer_get_time();
+  esp_sleep_enable_timer_wakeup(timeoutUs);
+  gpio_wakeup_enable((gpio_num_t)wakePin, level);
+  esp_sleep_enable_gpio_wakeup();
+  esp_light_sleep_start();
+  gpio_wakeup_disable((gpio_num_t)wakePin);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  uint64_t slept = esp_timer_get_time() - start;
+  powerStats.sleeps++;
+  powerStats.sleptUs += slept;
+  return slept;
+}
+
+uint32_t powerSleep(ld2410 &radar, bool allowed) {
+  if(powerMode == POWER_ALWAYS_ON) {
+    return 0;
+  }
+  trackFrames(radar);
+  if(!allowed || radar.commandsPending() > 0 || radar.calibrating()) {
+    delay(1);  // Still let the idle task halt the CPU
+    return 0;
+  }
+  if(powerMode == POWER_OUT_PIN && !outPinPresence() && !radar.presenceDetected()) {
+    powerStats.outPinSleeps++;
+    return lightSleep(POWER_IDLE_WAKE_US, powerOutPin, GPIO_INTR_HIGH_LEVEL);
+  }
+  int64_t wakeIn = (int64_t)(lastFrameUs + powerStats.frameIntervalUs - POWER_WAKE_GUARD_US) - esp_timer_get_time();
+  if(lastFrameUs == 0 || wakeIn < POWER_MIN_SLEEP_US) {
+    delay(1);  // A frame is about to arrive, or has been missed and the next one will set the timing again
+    return 0;
+  }
+  return lightSleep(wakeIn, powerRxPin, GPIO_INTR_LOW_LEVEL);  // RX idles high, a start bit wakes it
+}
+
+void getPowerStats(PowerStats &stats) {
+  stats = powerStats;
+}
@@ -0,0 +1,48 @@
+/*
+ * Light sleep for battery powered installs
+ *
+ * POWER_FRAME_SLEEP sleeps between radar frames. The UART can't receive
+ * in light sleep and the bytes that wake it are lost, so rather than
+ * waking on RX the sleep ends on a timer POWER_WAKE_GUARD_US before the
+ * next frame is due, from the interval measured between frames. A
+ * falling edge on RX still wakes it if the radar sends early.
+ * POWER_OUT_PIN also sleeps through empty rooms until the radar's OUT
+ * pin goes high, so only presence wakes the CPU, then sleeps between
+ * frames until presence ends.
+ *
+ * Light sleep drops the USB connection, so loop() only sleeps while no
+ * host is connected.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include <ld2410.h>
+
+#define POWER_ALWAYS_ON 0
+#define POWER_FRAME_SLEEP 1
+#define POWER_OUT_PIN 2
+
+#define POWER_WAKE_GUARD_US 4000        // Wake this long before a frame is due, covers the wake up time and frame jitter
+#define POWER_MIN_SLEEP_US 5000         // Shorter gaps are spent in delay(1) instead
+#define POWER_FRAME_INTERVAL_US 100000  // First guess at the radar's frame interval, refined as frames arrive
+#define POWER_MAX_FRAME_INTERVAL_US 1000000  // Longer gaps are missed frames, not the interval
+#define POWER_IDLE_WAKE_US 60000000ULL  // POWER_OUT_PIN also wakes this often with nobody present, to service commands and the radar
+
+struct PowerStats {
+  uint32_t sleeps;
+  uint32_t outPinSleeps;                // Of those, waiting for the OUT pin
+  uint64_t sleptUs;
+  uint32_t frameIntervalUs;             // Current estimate
+};
+
+// Set up the wake sources, outPin is only used with POWER_OUT_PIN
+void beginPower(uint8_t mode, int8_t rxPin, int8_t outPin);
+// The radar's OUT pin shows presence, always false unless POWER_OUT_PIN
+bool outPinPresence();
+// Call at the end of loop(). If nothing needs the CPU before the next frame and sleeping is allowed, light sleep until then, returns the us slept
+uint32_t powerSleep(ld2410 &radar, bool allowed);
+void getPowerStats(PowerStats &stats);
+
+#endif
@@ -0,0 +1,261 @@
+#include "telemetry.h"
+
+size_t TelemetryBatch::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t TelemetryBatch::write(const uint8_t *data, size_t length) {
+  if(length_ + length > TELEMETRY_BATCH_SIZE) {
+    flush();
+  }
+  if(length > TELEMETRY_BATCH_SIZE) {
+    return out_.write(data, length);  // Too big to batch
+  }
+  if(length_ == 0) {
+    firstByteTime_ = millis();
+  }
+  memcpy(buffer_ + length_, data, length);
+  length_ += length;
+  return length;
+}
+
+void TelemetryBatch::flush() {
+  if(length_ > 0) {
+    out_.write(buffer_, length_);
+    length_ = 0;
+  }
+}
+
+void TelemetryBatch::flushIfDue() {
+  if(length_ > 0 && millis() - firstByteTime_ >= TELEMETRY_FLUSH_INTERVAL) {
+    flush();
+  }
+}
+
+uint16_t telemetryCrc16(const uint8_t *data, size_t length) {
+  // CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF
+  uint16_t crc = 0xFFFF;
+  for(size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for(int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+size_t cobsEncode(const uint8_t *data, size_t length, uint8_t *encoded) {
+  // encoded must hold length + length / 254 + 1 bytes, no delimiter is written
+  size_t codeIndex = 0;
+  size_t out = 1;
+  uint8_t code = 1;
+  for(size_t i = 0; i < length; i++) {
+    if(data[i] == 0) {
+      encoded[codeIndex] = code;
+      codeIndex = out++;
+      code = 1;
+    } else {
+      encoded[out++] = data[i];
+      if(++code == 0xFF) {
+        encoded[codeIndex] = code;
+        codeIndex = out++;
+        code = 1;
+      }
+    }
+  }
+  encoded[codeIndex] = code;
+  return out;
+}
+
+size_t writeTelemetryRecord(Print &out, const void *record, size_t length) {
+  uint8_t raw[TELEMETRY_MAX_RECORD + 2];
+  uint8_t encoded[TELEMETRY_MAX_RECORD + 2 + (TELEMETRY_MAX_RECORD + 2) / 254 + 3];
+  if(length > TELEMETRY_MAX_RECORD) {
+    return 0;
+  }
+  memcpy(raw, record, length);
+  uint16_t crc = telemetryCrc16(raw, length);
+  raw[length] = crc & 0xFF;
+  raw[length + 1] = crc >> 8;
+  // Delimit both ends so stray text (e.g. library debug output) can't run into the record
+  encoded[0] = 0x00;
+  size_t encodedLength = 1 + cobsEncode(raw, length + 2, encoded + 1);
+  encoded[encodedLength++] = 0x00;
+  return out.write(encoded, encodedLength);
+}
+
+void fillTelemetryReport(TelemetryReport &report, const ld2410_report &frame, uint8_t sensorId, uint8_t flags) {
+  report.type = TELEMETRY_RECORD_REPORT;
+  report.version = TELEMETRY_VERSION;
+  report.sensorId = sensorId;
+  report.sequence = frame.sequence;
+  report.timestamp = (uint32_t)frame.timestamp_us;
+  report.flags = flags | (frame.engineering ? TELEMETRY_FLAG_ENGINEERING : 0) | (frame.out_pin ? TELEMETRY_FLAG_OUT_PIN : 0);
+  report.targetType = frame.target_type;
+  report.movingDistance = frame.moving_target_distance;
+  report.movingEnergy = frame.moving_target_energy;
+  report.stationaryDistance = frame.stationary_target_distance;
+  report.stationaryEnergy = frame.stationary_target_energy;
+  memcpy(report.movingGateEnergy, frame.moving_energy, 9);
+  memcpy(report.stationaryGateEnergy, frame.stationary_energy, 9);
+  report.lightLevel = frame.light_level;
+}
+
+void sendTelemetryReport(Print &out, const ld2410_report &frame, uint8_t sensorId, uint8_t flags) {
+  TelemetryReport report;
+  fillTelemetryReport(report, frame, sensorId, flags);
+  writeTelemetryRecord(out, &report, sizeof(report));
+}
+
+void sendTelemetryReport(Print &out, ld2410 &radar, uint8_t sensorId, uint8_t flags) {
+  ld2410_report frame;
+  radar.latestReport(frame);
+  sendTelemetryReport(out, frame, sensorId, flags);
+}
+
+void sendTelemetryConfig(Print &out, ld2410 &radar, uint8_t sensorId) {
+  TelemetryConfig config;
+  config.type = TELEMETRY_RECORD_CONFIG;
+  config.version = TELEMETRY_VERSION;
+  config.sensorId = sensorId;
+  config.maxGate = radar.max_gate;
+  config.maxMovingGate = radar.max_moving_gate;
+  config.maxStationaryGate = radar.max_stationary_gate;
+  config.idleTime = radar.sensor_idle_time;
+  memcpy(config.motionSensitivity, radar.motion_sensitivity, 9);
+  memcpy(config.stationarySensitivity, radar.stationary_sensitivity, 9);
+  writeTelemetryRecord(out, &config, sizeof(config));
+}
+
+void sendTelemetryPresence(Print &out, const ld2410_report &frame, uint8_t sensorId) {
+  TelemetryPresence presence;
+  presence.type = TELEMETRY_RECORD_PRESENCE;
+  presence.version = TELEMETRY_VERSION;
+  presence.sensorId = sensorId;
+  presence.sequence = frame.sequence;
+  presence.timestamp = (uint32_t)frame.timestamp_us;
+  presence.present = frame.presence ? 1 : 0;
+  presence.targetType = frame.target_type;
+  presence.distance = 0;
+  if((frame.target_type & 0x01) && frame.moving_target_distance > 0) {
+    presence.distance = frame.moving_target_distance;
+  }
+  if((frame.target_type & 0x02) && frame.stationary_target_distance > 0 &&
+     (presence.distance == 0 || frame.stationary_target_distance < presence.distance)) {
+    presence.distance = frame.stationary_target_distance;
+  }
+  writeTelemetryRecord(out, &presence, sizeof(presence));
+}
+
+void TelemetryDeltaEncoder::send(Print &out, const ld2410_report &frame, uint8_t sensorId, uint8_t flags) {
+  TelemetryReport report;
+  fillTelemetryReport(report, frame, sensorId, flags);
+  uint32_t sequenceOffset = report.sequence - keySequence_;
+  uint32_t timeOffset = (report.timestamp - keyTimestamp_) / TELEMETRY_DELTA_TIME_UNIT;
+  // A skipped frame would look like a lost record to the host, so resync with a keyframe instead
+  if(!haveKeyframe_ || report.sequence != sent_.sequence + 1 || sequenceOffset >= TELEMETRY_KEYFRAME_INTERVAL || timeOffset > 0xFFFF) {
+    writeTelemetryRecord(out, &report, sizeof(report));
+    sent_ = report;
+    keySequence_ = report.sequence;
+    keyTimestamp_ = report.timestamp;
+    haveKeyframe_ = true;
+    return;
+  }
+  uint8_t record[TELEMETRY_MAX_RECORD];
+  TelemetryDeltaHeader header;
+  size_t length = sizeof(header);
+  uint32_t mask = 0;
+  for(uint8_t i = 0; i < 18; i++) {
+    uint8_t &sent = i < 9 ? sent_.movingGateEnergy[i] : sent_.stationaryGateEnergy[i - 9];
+    uint8_t current = i < 9 ? report.movingGateEnergy[i] : report.stationaryGateEnergy[i - 9];
+    int16_t change = (int16_t)current - sent;
+    if(change > deadband_ || change < -deadband_) {
+      mask |= 1UL << i;
+      record[length++] = (uint8_t)(int8_t)change;  // Energies are 0-100 so this fits
+      sent = current;
+    }
+  }
+  if(report.flags != sent_.flags || report.targetType != sent_.targetType) {
+    mask |= TELEMETRY_DELTA_TARGET_TYPE;
+    record[length++] = report.flags;
+    record[length++] = report.targetType;
+  }
+  if(report.movingDistance != sent_.movingDistance || report.movingEnergy != sent_.movingEnergy) {
+    mask |= TELEMETRY_DELTA_MOVING;
+    record[length++] = report.movingDistance & 0xFF;
+    record[length++] = report.movingDistance >> 8;
+    record[length++] = report.movingEnergy;
+  }
+  if(report.stationaryDistance != sent_.stationaryDistance || report.stationaryEnergy != sent_.stationaryEnergy) {
+    mask |= TELEMETRY_DELTA_STATIONARY;
+    record[length++] = report.stationaryDistance & 0xFF;
+    record[length++] = report.stationaryDistance >> 8;
+    record[length++] = report.stationaryEnergy;
+  }
+  if(report.lightLevel != sent_.lightLevel) {
+    mask |= TELEMETRY_DELTA_LIGHT;
+    record[length++] = report.lightLevel;
+  }
+  header.type = TELEMETRY_RECORD_DELTA;
+  header.version = TELEMETRY_VERSION;
+  header.sensorId = sensorId;
+  header.sequenceOffset = sequenceOffset;
+  header.timeOffset = timeOffset;
+  header.mask[0] = mask & 0xFF;
+  header.mask[1] = (mask >> 8) & 0xFF;
+  header.mask[2] = mask >> 16;
+  memcpy(record, &header, sizeof(header));
+  sent_.sequence = report.sequence;
+  sent_.timestamp = report.timestamp;
+  sent_.flags = report.flags;
+  sent_.targetType = report.targetType;
+  sent_.movingDistance = report.movingDistance;
+  sent_.movingEnergy = report.movingEnergy;
+  sent_.stationaryDistance = report.stationaryDistance;
+  sent_.stationaryEnergy = report.stationaryEnergy;
+  sent_.lightLevel = report.lightLevel;
+  writeTelemetryRecord(out, record, length);
+}
+
+void sendTelemetrySummary(Print &out, ld2410_gate_statistics &statistics, uint32_t windowMs, uint8_t sensorId) {
+  TelemetrySummary summary;
+  summary.type = TELEMETRY_RECORD_SUMMARY;
+  summary.version = TELEMETRY_VERSION;
+  summary.sensorId = sensorId;
+  summary.frames = statistics.frames();
+  summary.windowMs = windowMs;
+  for(uint8_t i = 0; i < LD2410_STATISTICS_GATES; i++) {
+    summary.mean[i] = statistics.mean(i);
+    summary.average[i] = statistics.average(i);
+    summary.minimum[i] = statistics.minimum(i);
+    summary.maximum[i] = statistics.maximum(i);
+    summary.variance[i] = statistics.variance(i);
+  }
+  writeTelemetryRecord(out, &summary, sizeof(summary));
+}
+
+void sendTelemetryStats(Print &out, ld2410 &radar, uint8_t sensorId) {
+  ld2410_counters counters;
+  radar.getCounters(counters);
+  TelemetryStats stats;
+  stats.type = TELEMETRY_RECORD_STATS;
+  stats.version = TELEMETRY_VERSION;
+  stats.sensorId = sensorId;
+  stats.bytesReceived = counters.bytes_received;
+  stats.bytesDiscarded = counters.bytes_discarded;
+  stats.receiveOverflowBytes = counters.receive_overflow_bytes;
+  stats.uartHighWater = counters.uart_high_water;
+  stats.dataFrames = counters.data_frames;
+  stats.ackFrames = counters.ack_frames;
+  stats.unknownFrames = counters.unknown_frames;
+  stats.lengthMismatches = counters.length_mismatches;
+  stats.frameOverruns = counters.frame_overruns;
+  stats.commandsSent = counters.commands_sent;
+  stats.commandTimeouts = counters.command_timeouts;
+  stats.reportsDropped = radar.reportsDropped();
+  stats.parsePasses = counters.parse_passes;
+  stats.parseCyclesMin = counters.parse_cycles_min;
+  stats.parseCyclesAverage = counters.parse_passes > 0 ? counters.parse_cycles_total / counters.parse_passes : 0;
+  stats.parseCyclesMax = counters.parse_cycles_max;
+  writeTelemetryRecord(out, &stats, sizeof(stats));
+}
@@ -0,0 +1,179 @@
+/*
+ * Binary telemetry records sent to the host instead of text lines
+ *
+ * Each record is a packed little-endian struct followed by a CRC-16/CCITT
+ * of the struct, COBS encoded and delimited by 0x00 bytes. The host
+ * decoder is radar_telemetry.py, keep the two layouts in step.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <ld2410.h>
+
+#define TELEMETRY_VERSION 4
+#define TELEMETRY_RECORD_REPORT 0x01
+#define TELEMETRY_RECORD_CONFIG 0x02
+#define TELEMETRY_RECORD_PRESENCE 0x03
+#define TELEMETRY_RECORD_DELTA 0x04         // Changes since the previous report from the same sensor, see TelemetryDeltaEncoder
+#define TELEMETRY_RECORD_SUMMARY 0x05       // Gate statistics over a window of frames
+#define TELEMETRY_RECORD_STATS 0x06         // Parser and command counters, in reply to STATS
+#define TELEMETRY_FLAG_ENGINEERING 0x01   // Gate energies are valid
+#define TELEMETRY_FLAG_FUSED_PRESENCE 0x02  // Some sensor on this controller detected a target when the record was sent
+#define TELEMETRY_FLAG_OUT_PIN 0x04       // The radar's OUT pin was high, engineering frames only
+#define TELEMETRY_MAX_RECORD 128          // Largest record struct, before CRC and COBS overhead
+#define TELEMETRY_BATCH_SIZE 512          // Output collected before one write to the USB CDC
+#define TELEMETRY_FLUSH_INTERVAL 20       // ms, longest a batched record waits to be sent
+#define TELEMETRY_KEYFRAME_INTERVAL 50    // Delta encoding sends a full report at least every this many frames
+#define TELEMETRY_DELTA_DEADBAND 2        // Gate energy changes of this much or less aren't sent
+#define TELEMETRY_DELTA_TIME_UNIT 100     // us per count of a delta record's time offset
+
+// Delta record change mask, bits 0-8 moving gates, 9-17 stationary gates
+#define TELEMETRY_DELTA_TARGET_TYPE (1UL << 18)  // flags, targetType follow
+#define TELEMETRY_DELTA_MOVING (1UL << 19)       // movingDistance, movingEnergy follow
+#define TELEMETRY_DELTA_STATIONARY (1UL << 20)   // stationaryDistance, stationaryEnergy follow
+#define TELEMETRY_DELTA_LIGHT (1UL << 21)        // lightLevel follows
+
+struct __attribute__((packed)) TelemetryReport {
+  uint8_t type;                   // TELEMETRY_RECORD_REPORT
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;               // Which radar on this controller
+  uint32_t sequence;              // Radar frame sequence number, for spotting gaps and repeats
+  uint32_t timestamp;             // Frame capture time, microseconds since boot (wraps every ~71 minutes)
+  uint8_t flags;                  // TELEMETRY_FLAG_*
+  uint8_t targetType;             // 0 none, bit 0 moving, bit 1 stationary
+  uint16_t movingDistance;        // cm
+  uint8_t movingEnergy;
+  uint16_t stationaryDistance;    // cm
+  uint8_t stationaryEnergy;
+  uint8_t movingGateEnergy[9];
+  uint8_t stationaryGateEnergy[9];
+  uint8_t lightLevel;             // Photosensitive value 0-255, engineering frames from firmware that sends it
+};
+
+struct __attribute__((packed)) TelemetryConfig {
+  uint8_t type;                   // TELEMETRY_RECORD_CONFIG
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;
+  uint8_t maxGate;
+  uint8_t maxMovingGate;
+  uint8_t maxStationaryGate;
+  uint16_t idleTime;              // seconds
+  uint8_t motionSensitivity[9];
+  uint8_t stationarySensitivity[9];
+};
+
+// Sent only when a sensor's filtered presence changes
+struct __attribute__((packed)) TelemetryPresence {
+  uint8_t type;                   // TELEMETRY_RECORD_PRESENCE
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;
+  uint32_t sequence;              // Radar frame that changed it
+  uint32_t timestamp;             // microseconds since boot
+  uint8_t present;                // 1 presence started, 0 ended
+  uint8_t targetType;
+  uint16_t distance;              // cm, nearest target in the frame, 0 for none
+};
+
+// Gates are moving 0-8 then stationary 0-8, as in ld2410_gate_statistics
+struct __attribute__((packed)) TelemetrySummary {
+  uint8_t type;                   // TELEMETRY_RECORD_SUMMARY
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;
+  uint16_t frames;                // Engineering frames in the window
+  uint32_t windowMs;              // How long the window was
+  uint8_t mean[18];
+  uint8_t average[18];            // Exponential moving average at the end of the window
+  uint8_t minimum[18];
+  uint8_t maximum[18];
+  uint16_t variance[18];
+};
+
+struct __attribute__((packed)) TelemetryStats {
+  uint8_t type;                   // TELEMETRY_RECORD_STATS
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;
+  uint32_t bytesReceived;         // Counts since boot, see ld2410_counters
+  uint32_t bytesDiscarded;
+  uint32_t receiveOverflowBytes;
+  uint16_t uartHighWater;
+  uint32_t dataFrames;
+  uint32_t ackFrames;
+  uint32_t unknownFrames;
+  uint32_t lengthMismatches;
+  uint32_t frameOverruns;
+  uint32_t commandsSent;
+  uint32_t commandTimeouts;
+  uint32_t reportsDropped;        // Frames lost before the firmware took them from the history
+  uint32_t parsePasses;
+  uint32_t parseCyclesMin;        // CPU cycles per read that completed a frame
+  uint32_t parseCyclesAverage;
+  uint32_t parseCyclesMax;
+};
+
+static_assert(sizeof(TelemetryReport) == 38, "TelemetryReport layout is shared with radar_telemetry.py");
+static_assert(sizeof(TelemetryConfig) == 26, "TelemetryConfig layout is shared with radar_telemetry.py");
+static_assert(sizeof(TelemetryPresence) == 15, "TelemetryPresence layout is shared with radar_telemetry.py");
+static_assert(sizeof(TelemetrySummary) == 117, "TelemetrySummary layout is shared with radar_telemetry.py");
+static_assert(sizeof(TelemetryStats) == 65, "TelemetryStats layout is shared with radar_telemetry.py");
+static_assert(sizeof(TelemetrySummary) <= TELEMETRY_MAX_RECORD, "TELEMETRY_MAX_RECORD is too small");
+
+// Header of a TELEMETRY_RECORD_DELTA record. It is followed, in mask bit order, by an
+// int8 change for each gate bit and the fields of each TELEMETRY_DELTA_* bit
+struct __attribute__((packed)) TelemetryDeltaHeader {
+  uint8_t type;                   // TELEMETRY_RECORD_DELTA
+  uint8_t version;                // TELEMETRY_VERSION
+  uint8_t sensorId;
+  uint8_t sequenceOffset;         // Frames since the keyframe, each frame gets a record so the host can spot a lost one
+  uint16_t timeOffset;            // Since the keyframe, in TELEMETRY_DELTA_TIME_UNIT
+  uint8_t mask[3];                // Little-endian change mask
+};
+
+static_assert(sizeof(TelemetryDeltaHeader) == 9, "TelemetryDeltaHeader layout is shared with radar_telemetry.py");
+
+// Collects output and hands it to the underlying Print in large writes
+class TelemetryBatch : public Print {
+ public:
+  explicit TelemetryBatch(Print &out) : out_(out) {}
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t *data, size_t length) override;
+  using Print::write;
+  void flush() override;                  // Send everything collected so far
+  void flushIfDue();                       // Send if the oldest byte has waited TELEMETRY_FLUSH_INTERVAL
+ private:
+  Print &out_;
+  uint8_t buffer_[TELEMETRY_BATCH_SIZE];
+  size_t length_ = 0;
+  uint32_t firstByteTime_ = 0;
+};
+
+// Sends one sensor's frames as a full keyframe report followed by delta records.
+// Deltas are taken against what the host last saw rather than the previous frame,
+// so changes inside the dead-band can't add up to a drift
+class TelemetryDeltaEncoder {
+ public:
+  explicit TelemetryDeltaEncoder(uint8_t deadband = TELEMETRY_DELTA_DEADBAND) : deadband_(deadband) {}
+  void send(Print &out, const ld2410_report &frame, uint8_t sensorId = 0, uint8_t flags = 0);
+  void reset() { haveKeyframe_ = false; }  // Start again with a keyframe, e.g. when the host connects
+ private:
+  uint8_t deadband_;
+  bool haveKeyframe_ = false;
+  TelemetryReport sent_;                   // The report as the host has reconstructed it
+  uint32_t keySequence_ = 0;
+  uint32_t keyTimestamp_ = 0;
+};
+
+uint16_t telemetryCrc16(const uint8_t *data, size_t length);
+size_t cobsEncode(const uint8_t *data, size_t length, uint8_t *encoded);
+size_t writeTelemetryRecord(Print &out, const void *record, size_t length);
+// flags are ORed into the record's own, e.g. TELEMETRY_FLAG_FUSED_PRESENCE
+void fillTelemetryReport(TelemetryReport &report, const ld2410_report &frame, uint8_t sensorId = 0, uint8_t flags = 0);
+void sendTelemetryReport(Print &out, const ld2410_report &frame, uint8_t sensorId = 0, uint8_t flags = 0);
+void sendTelemetryReport(Print &out, ld2410 &radar, uint8_t sensorId = 0, uint8_t flags = 0);  // Latest frame
+void sendTelemetryConfig(Print &out, ld2410 &radar, uint8_t sensorId = 0);
+void sendTelemetryPresence(Print &out, const ld2410_report &frame, uint8_t sensorId = 0);
+void sendTelemetrySummary(Print &out, ld2410_gate_statistics &statistics, uint32_t windowMs, uint8_t sensorId = 0);
+void sendTelemetryStats(Print &out, ld2410 &radar, uint8_t sensorId = 0);
+
+#endif